@@ -0,0 +1,80 @@
+/**
+ * @file asyncFaceDetect.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief face detection on a background thread, off the render path
+ * @version 0.1
+ * @date 2024-02-24
+*/
+
+#ifndef ASYNCFACEDETECT_H
+#define ASYNCFACEDETECT_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "faceTrack.h"
+
+// faces found in one frame, in the coordinates of the submitted frame
+struct FaceResult {
+    std::vector<cv::Rect> faces;
+    long long frameIndex = -1;  // index passed to submit()
+    double timestamp = 0.0;     // timestamp passed to submit()
+    double latencyMs = 0.0;     // from timestamp to the result being published
+};
+
+// A worker thread that always runs the detector on the newest submitted
+// frame; frames that arrive while it is busy replace each other, so a slow
+// cascade never builds a backlog. The render path hands frames over with
+// submit() and polls latest(), neither of which waits for the detector.
+class AsyncFaceDetector {
+public:
+    // frames are shrunk by scale before detection; tracking as in FaceTracker
+    explicit AsyncFaceDetector(double scale = 0.5, const FaceTrackerParams &params = FaceTrackerParams());
+    ~AsyncFaceDetector();
+
+    // queue a BGR frame, replacing one the worker has not started on yet
+    void submit(const cv::Mat &frame, long long frameIndex, double timestamp);
+
+    // copy the newest result; returns false if there is none yet or the
+    // worker is publishing right now (keep using the previous result then)
+    bool latest(FaceResult &result) const;
+
+    // like latest(), but waits for the result of the frame submitted as
+    // frameIndex; for offline use, where every frame should get its own faces
+    bool wait(long long frameIndex, FaceResult &result) const;
+
+    // forget the queued frame, the last result and the tracks, e.g. before
+    // an unrelated video; a detection still running is thrown away
+    void reset();
+
+private:
+    void run();
+
+    double scale_;
+    FaceTracker tracker_;
+
+    // input slot, guarded by inLock_
+    std::mutex inLock_;
+    std::condition_variable inReady_;
+    cv::Mat pending_;
+    long long pendingIndex_;
+    double pendingTime_;
+    bool hasPending_;
+    bool stop_;
+    bool resetTracks_;  // the worker resets tracker_ before its next frame
+
+    // output slot, guarded by outLock_
+    mutable std::mutex outLock_;
+    mutable std::condition_variable outReady_;
+    FaceResult result_;
+    bool hasResult_;
+
+    // bumped by reset() under both locks; results of an older one are dropped
+    long long generation_;
+
+    std::thread worker_;
+};
+
+#endif // ASYNCFACEDETECT_H
@@ -0,0 +1,27 @@
+/**
+ * @file blurKernel.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row kernels for the separable [1 2 4 2 1] Gaussian blur
+ * @version 0.1
+ * @date 2024-02-10
+*/
+
+#ifndef BLURKERNEL_H
+#define BLURKERNEL_H
+
+// Rows are interleaved (BGRBGR...) 8-bit data, cols is the pixel count and
+// cn the channel count. Both kernels only write the interior bytes
+// [2 * cn, (cols - 2) * cn); the two border pixels on each side are left alone.
+
+// horizontal pass: dst[i] = (s[i-2cn] + 2s[i-cn] + 4s[i] + 2s[i+cn] + s[i+2cn]) / 10
+void blur5RowH(const unsigned char *src, unsigned char *dst, int cols, int cn);
+
+// vertical pass: dst[i] = (r0[i] + 2r1[i] + 4r2[i] + 2r3[i] + r4[i]) / 10
+void blur5RowV(const unsigned char *r0, const unsigned char *r1, const unsigned char *r2,
+               const unsigned char *r3, const unsigned char *r4,
+               unsigned char *dst, int cols, int cn);
+
+// name of the instruction set the kernels run with (see kernels.h)
+const char *blurKernelISA();
+
+#endif // BLURKERNEL_H
@@ -9,11 +9,15 @@
 #ifndef FACEDETECT_H
 #define FACEDETECT_H
 
-// put the path to the haar cascade file here
+// put the path to the haar cascade file here, or pass -DFACE_CASCADE_FILE=...;
+// the FACE_CASCADE environment variable overrides it at run time
+#ifndef FACE_CASCADE_FILE
 #define FACE_CASCADE_FILE "/Users/jeff/Desktop/Project1_YZ/build/haarcascade_frontalface_alt2.xml"
+#endif
 
 // prototypes
 int detectFaces( cv::Mat &grey, std::vector<cv::Rect> &faces );
+int detectFacesInRegion( cv::Mat &grey, cv::Rect region, std::vector<cv::Rect> &faces, int minSize = 0 );
 int drawBoxes( cv::Mat &frame, std::vector<cv::Rect> &faces, int minWidth = 50, float scale = 1.0  );
 
 #endif
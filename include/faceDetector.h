@@ -0,0 +1,115 @@
+/**
+ * @file faceDetector.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief reentrant Haar cascade face detector and a per-thread pool of them
+ * @version 0.1
+ * @date 2024-03-11
+*/
+
+#ifndef FACEDETECTOR_H
+#define FACEDETECTOR_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+struct FaceDetectorParams {
+    std::string model;         // cascade file; empty = defaultFaceModel()
+    double downscale = 0.5;    // detect() searches a copy shrunk by this factor, 1 = full size
+    bool equalize = true;      // equalize the histogram before searching
+    double scaleFactor = 1.1;  // detectMultiScale: size step between the scales searched
+    int minNeighbors = 3;      // detectMultiScale: overlapping hits needed to keep a face
+    cv::Size minSize, maxSize; // smallest / largest face in the caller's pixels; empty = no limit
+    bool parallel = false;     // FaceDetectorPool::detect(): split scales and tiles over the filter threads
+};
+
+// the cascade named by the FACE_CASCADE environment variable, else FACE_CASCADE_FILE
+std::string defaultFaceModel();
+
+// Non-maximum suppression: of two boxes that overlap by more than overlap
+// (intersection over union) or where one lies inside the other, the one with
+// the lower score goes. boxes and scores are filtered in place.
+void suppressOverlaps(std::vector<cv::Rect> &boxes, std::vector<int> &scores, double overlap = 0.3);
+
+class FaceDetectorPool;
+
+// A Haar cascade with its own scratch buffers, so separate instances can
+// detect on separate threads at the same time. One instance must not be
+// used by two threads at once; FaceDetectorPool hands out one per thread.
+class FaceDetector {
+public:
+    explicit FaceDetector(const FaceDetectorParams &params = FaceDetectorParams());
+
+    // load the model; false, with error set, if it is missing or not a cascade
+    bool load(std::string *error = NULL);
+    bool loaded() const { return !cascade_.empty(); }
+
+    // faces in a greyscale frame, in its coordinates; -1 if no model is loaded
+    int detect(const cv::Mat &grey, std::vector<cv::Rect> &faces);
+
+    // Search only region, at full resolution: much cheaper than detect() when
+    // the region is small, e.g. around a face found in the last frame.
+    // Faces narrower than minSize are skipped. Returns -1 if no model is loaded.
+    int detectInRegion(const cv::Mat &grey, cv::Rect region, std::vector<cv::Rect> &faces, int minSize = 0);
+
+    // detect() with the work spread over threads: every scale of the pyramid
+    // is cut into tiles that overlap by one detection window, the tiles run
+    // in parallel on the detectors of workers (same model and settings), and
+    // the raw hits are grouped as detectMultiScale groups them, then merged
+    // across scales with suppressOverlaps().
+    int detectParallel(const cv::Mat &grey, std::vector<cv::Rect> &faces, FaceDetectorPool &workers);
+
+    const FaceDetectorParams &params() const { return params_; }
+
+private:
+    FaceDetectorParams params_;
+    cv::CascadeClassifier cascade_;
+    cv::Mat small_, roi_;
+    // detectParallel: the tiles and what each one found
+    struct Tile {
+        cv::Rect core;   // hits whose top left corner lies here belong to this tile
+        cv::Rect area;   // core plus one window to the right and below
+        cv::Size window; // the one window size searched
+    };
+    std::vector<Tile> tiles_;
+    std::vector<std::vector<cv::Rect> > hits_;
+};
+
+// One FaceDetector per thread that asks, created and loaded on its first
+// call to local() and owned by the pool, so they are all released with it.
+// Threads never share a detector, so detection scales across cores; the
+// lock only guards the lookup.
+class FaceDetectorPool {
+public:
+    explicit FaceDetectorPool(const FaceDetectorParams &params = FaceDetectorParams());
+
+    // the calling thread's detector; NULL if the model does not load (the
+    // reason is printed once per pool)
+    FaceDetector *local();
+
+    // drop the calling thread's detector; a thread that ends long before the
+    // pool (e.g. a background detector's) calls this on its way out
+    void release();
+
+    // detect faces with the calling thread's detector, in parallel when
+    // params().parallel is set; -1 if the model does not load
+    int detect(const cv::Mat &grey, std::vector<cv::Rect> &faces);
+
+    const FaceDetectorParams &params() const { return params_; }
+
+private:
+    FaceDetectorParams params_;
+    std::mutex lock_;
+    std::map<std::thread::id, std::unique_ptr<FaceDetector> > detectors_;
+    std::atomic<bool> warned_;
+};
+
+// the pool with the default parameters, used by detectFaces and FaceTracker
+FaceDetectorPool &defaultFaceDetectors();
+
+#endif // FACEDETECTOR_H
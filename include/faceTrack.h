@@ -0,0 +1,77 @@
+/**
+ * @file faceTrack.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief detect-then-track face tracker on top of FaceDetector
+ * @version 0.1
+ * @date 2024-02-22
+*/
+
+#ifndef FACETRACK_H
+#define FACETRACK_H
+
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "faceDetector.h"
+
+// one tracked face; position and size are smoothed by an alpha-beta filter
+struct FaceTrack {
+    int id;
+    cv::Point2d center;     // filtered centre
+    cv::Point2d velocity;   // centre motion in pixels per frame
+    cv::Size2d size;        // filtered width / height
+    double confidence;      // 1 after a detection, decays on every miss
+    int misses;             // frames in a row without a detection
+    int age;                // frames since the track was created
+
+    cv::Rect rect() const;
+};
+
+struct FaceTrackerParams {
+    int detectInterval = 10;     // full-frame cascade at least every N frames
+    double minConfidence = 0.5;  // ... or as soon as a track drops below this
+    double searchScale = 2.0;    // ROI searched around a track, relative to its size
+    double alpha = 0.5;          // position / size gain of the alpha-beta filter
+    double beta = 0.1;           // velocity gain
+    int maxMisses = 3;           // a track is dropped after this many misses
+    double matchIoU = 0.3;       // overlap needed to assign a detection to a track
+    std::shared_ptr<FaceDetectorPool> detectors; // cascade and its settings; NULL = defaultFaceDetectors()
+};
+
+// Runs the full Haar cascade every detectInterval frames (or when a track
+// gets unsure) and in between only searches small regions around the
+// predicted position of each face.
+class FaceTracker {
+public:
+    explicit FaceTracker(const FaceTrackerParams &params = FaceTrackerParams());
+
+    // process one greyscale frame; faces receives the smoothed face boxes.
+    // Returns -1 on an empty frame or if the cascade cannot be loaded.
+    int update(cv::Mat &grey, std::vector<cv::Rect> &faces);
+
+    // forget every track, the next update runs the full detector
+    void reset();
+
+    // the pool update() detects with
+    FaceDetectorPool &detectors() const;
+
+    const std::vector<FaceTrack> &tracks() const { return tracks_; }
+    // true if the last update ran the full-frame detector
+    bool lastWasFullDetect() const { return lastFull_; }
+
+private:
+    void correct(FaceTrack &t, const cv::Rect &measured);
+    void addTrack(const cv::Rect &measured);
+
+    FaceTrackerParams params_;
+    std::vector<FaceTrack> tracks_;
+    std::vector<cv::Rect> detections_;
+    int framesSinceDetect_;
+    int nextId_;
+    bool lastFull_;
+};
+
+// intersection over union of two boxes
+double rectIoU(const cv::Rect &a, const cv::Rect &b);
+
+#endif // FACETRACK_H
@@ -10,28 +10,50 @@
 #define FILTER_H
 
 #include <opencv2/opencv.hpp>
+#include <vector>
+#include "stencil.h"
 
-// Task 4: alt greyscale function
-int greyscale(cv::Mat &src, cv::Mat &dst);
+// Task 4: alt greyscale function; channels = 1 gives a single CV_8UC1 luminance
+// plane instead of three equal channels
+int greyscale(cv::Mat &src, cv::Mat &dst, int channels = 3);
 
 // Task 5: sepia tone function
 int sepiaTone(cv::Mat &src, cv::Mat &dst);
 
+// The stencil filters take a StencilBorder (stencil.h) for the pixels whose
+// neighbourhood runs off the image. Blur, Sobel, magnitude, gradientFused,
+// emboss and blurQuantize also take single-channel images (CV_8UC1, or
+// CV_16SC1 from Sobel), e.g. the luminance from greyscale(src, dst, 1).
+
 // Task 6: 5 x 5 Gaussian blur function A
-int blur5x5_1(cv::Mat &src, cv::Mat &dst);
+int blur5x5_1(cv::Mat &src, cv::Mat &dst, int border = STENCIL_BORDER_KEEP);
 
 // Task 6: 5 x 5 Gaussian blur function B
-int blur5x5_2(cv::Mat &src, cv::Mat &dst);
+int blur5x5_2(cv::Mat &src, cv::Mat &dst, int border = STENCIL_BORDER_KEEP);
 
-// Task 7: Sobel_X 3 x 3 function
-int sobelX3x3( cv::Mat &src, cv::Mat &dst );
+// Task 7: Sobel_X 3 x 3 function; the default border gives 0 on the left and right edge
+int sobelX3x3( cv::Mat &src, cv::Mat &dst, int border = STENCIL_BORDER_REFLECT );
 
-// Task 7: Sobel_Y 3 x 3 function
-int sobelY3x3( cv::Mat &src, cv::Mat &dst );
+// Task 7: Sobel_Y 3 x 3 function; the default border gives 0 on the top and bottom edge
+int sobelY3x3( cv::Mat &src, cv::Mat &dst, int border = STENCIL_BORDER_REFLECT );
 
 // Task 8: magnitude for Sobel_X & Sobel_Y
 int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst);
 
+// Task 8: Sobel X/Y, magnitude and emboss in one pass over the source,
+// without the CV_16SC3 intermediates; pass NULL for an output you do not need
+int gradientFused(cv::Mat &src, cv::Mat *mag, cv::Mat *emboss);
+
+// Planar (structure of arrays) versions of the stencil filters: one CV_8UC1
+// Mat per channel, as cv::split gives them; each plane runs the
+// single-channel path. Split once, chain these, and cv::merge at the end.
+int blur5x5_1(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border = STENCIL_BORDER_KEEP);
+int blur5x5_2(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border = STENCIL_BORDER_KEEP);
+int sobelX3x3(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border = STENCIL_BORDER_REFLECT);
+int sobelY3x3(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border = STENCIL_BORDER_REFLECT);
+int magnitude(std::vector<cv::Mat> &sx, std::vector<cv::Mat> &sy, std::vector<cv::Mat> &dst);
+int gradientFused(std::vector<cv::Mat> &src, std::vector<cv::Mat> *mag, std::vector<cv::Mat> *emboss);
+
 // Task 9: blurs and quantizes the image
 int blurQuantize( cv::Mat &src, cv::Mat &dst, int levels );
 
@@ -43,7 +65,7 @@ int negativeFilter(cv::Mat &src, cv::Mat &dst);
 int embossEffect(cv::Mat &src, cv::Mat &dst);
 
 // Task 11: other filter 3 - face detect 
-// colorful faces, grayscale background
+// colorful faces, grayscale background, in one pass; faces are clipped to the frame
 int colorfulFaces(cv::Mat &src, std::vector<cv::Rect> &faces, cv::Mat &dst);
 
 // Extension Part 2: cartoon filter
@@ -0,0 +1,65 @@
+/**
+ * @file framePool.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief pooled cv::Mat allocator, so steady-state frame processing does not hit the heap
+ * @version 0.1
+ * @date 2024-03-01
+*/
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// counters of a PoolAllocator, see PoolAllocator::stats
+struct PoolStats {
+    long long allocations = 0; // Mat buffers handed out
+    long long reused = 0;      // ... of which came from the pool
+    long long heapAllocs = 0;  // ... of which had to be malloc'ed
+    long long heapFrees = 0;   // buffers given back to the heap (pool over its limit, or trim)
+    size_t bytesInUse = 0;     // held by live Mats
+    size_t bytesPooled = 0;    // free, waiting in the pool
+};
+
+// A cv::MatAllocator that keeps released buffers on free lists keyed by their
+// byte size (so by size and type together) and hands them out again for the
+// next Mat of that size. After the first frame or two every Mat a filter
+// creates is a reuse. UMatData headers are recycled along with the buffers.
+class PoolAllocator : public cv::MatAllocator {
+public:
+    // free buffers above maxPooledBytes go back to the heap
+    explicit PoolAllocator(size_t maxPooledBytes = (size_t)512 << 20);
+    ~PoolAllocator();
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessflags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData *data) const override;
+
+    PoolStats stats() const;
+
+    // give every pooled buffer back to the heap
+    void trim();
+
+private:
+    mutable std::mutex lock_;
+    mutable std::unordered_map<size_t, std::vector<cv::UMatData *> > free_;
+    mutable PoolStats stats_;
+    size_t maxPooledBytes_;
+};
+
+// Make the pool the default allocator of every new cv::Mat (once; later calls
+// return the same pool). The pool is never destroyed, as Mats may outlive main.
+PoolAllocator &installFramePool();
+
+// the installed pool, or NULL when installFramePool was never called
+PoolAllocator *framePool();
+
+// one line summary of the counters, e.g. for the end of a run
+void printPoolStats(const PoolStats &s);
+
+#endif // FRAMEPOOL_H
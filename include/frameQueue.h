@@ -0,0 +1,120 @@
+/**
+ * @file frameQueue.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief lock-free bounded queue used to hand frames between threads
+ * @version 0.1
+ * @date 2024-02-16
+*/
+
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+// a frame travelling through the capture / process / display / record threads
+struct Frame {
+    cv::Mat image;
+    long long index = 0;     // capture sequence number
+    double timestamp = 0.0;  // capture time in seconds (cv::getTickCount based)
+};
+
+// Bounded multi-producer / multi-consumer queue without locks: every cell
+// carries a sequence number that tells producers and consumers whose turn it
+// is (D. Vyukov's design). Capacity is rounded up to a power of two. Items are
+// moved in and out, so cv::Mat buffers change hands without copying.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : head_(0), tail_(0) {
+        size_t n = 2;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        mask_ = n - 1;
+        cells_.reset(new Cell[n]);
+        for (size_t i = 0; i < n; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // move item in; returns false (and leaves item alone) when the queue is full
+    bool tryPush(T &item) {
+        Cell *cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // move the oldest item out; returns false when the queue is empty
+    bool tryPop(T &item) {
+        Cell *cell;
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Drop-oldest push: when the queue is full the oldest item is taken out
+    // into evicted (so its buffer can be recycled) to make room. Returns true
+    // if something was evicted.
+    bool pushDropOldest(T &item, T &evicted) {
+        bool dropped = false;
+        while (!tryPush(item)) {
+            T old;
+            if (tryPop(old)) {
+                evicted = std::move(old);
+                dropped = true;
+            }
+        }
+        return dropped;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    // producers and consumers work on different cache lines
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+#endif // FRAMEQUEUE_H
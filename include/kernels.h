@@ -0,0 +1,43 @@
+/**
+ * @file kernels.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief per-instruction-set variants of the filter row kernels, picked at run time
+ * @version 0.1
+ * @date 2024-03-05
+*/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <vector>
+
+// One build of the row kernels. Every variant gives the same bytes as the
+// scalar one; they only differ in speed.
+struct FilterKernels {
+    const char *isa; // "scalar", "sse4.1", "avx2" or "avx512"
+
+    // dst[i] = (a[i] + 2b[i] + 4c[i] + 2d[i] + e[i]) / 10, i in [0, n)
+    void (*weightedSum5)(const unsigned char *a, const unsigned char *b, const unsigned char *c,
+                         const unsigned char *d, const unsigned char *e, unsigned char *dst, int n);
+
+    // gradient magnitude of n interleaved bytes with cn channels:
+    // dst[i] = saturate(round(sqrt(gx^2 + gy^2))), gx = mid[i+cn] - mid[i-cn], gy = down[i] - up[i]
+    void (*gradientMag)(const unsigned char *up, const unsigned char *mid, const unsigned char *down,
+                        unsigned char *dst, int n, int cn);
+};
+
+// The kernels in use. On first use the widest variant the CPU supports is
+// chosen, unless the FILTER_ISA environment variable names another one.
+const FilterKernels &filterKernels();
+
+// switch to the named variant; returns -1 if it is not built or the CPU lacks it
+int selectFilterKernels(const char *isa);
+
+// every variant this binary has and this CPU can run, scalar first
+std::vector<const FilterKernels *> availableFilterKernels();
+
+// compare every available variant with the scalar one on random rows;
+// returns the number of mismatching cases (0 = all bit-identical)
+int verifyFilterKernels(bool verbose);
+
+#endif // KERNELS_H
@@ -0,0 +1,185 @@
+/**
+ * @file kernelsImpl.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief body of the row kernels, compiled once per instruction set
+ * @version 0.1
+ * @date 2024-03-05
+*/
+
+// Included by kernelsScalar.cpp, kernelsSSE41.cpp, kernelsAVX2.cpp and
+// kernelsAVX512.cpp, each built with its own -m flags and defining
+// KERNEL_NS. The #if blocks below pick the widest code those flags allow;
+// the scalar loops finish the tail of each row. No include guard on purpose.
+//
+// Nothing here may use an inline function or template from another header
+// (OpenCV, stencil.h, the C++ <cmath> overloads): those are emitted in every
+// one of these files, each with its own -m flags, and the linker keeps just
+// one copy, possibly the AVX-512 one for a CPU without it. The tails are
+// plain loops that only call the C library.
+
+#ifndef KERNEL_NS
+#error "define KERNEL_NS before including kernelsImpl.h"
+#endif
+
+#include <math.h>
+#include "kernels.h"
+
+#if !defined(KERNEL_SCALAR) && (defined(__SSE4_1__) || defined(__AVX2__) || defined(__AVX512BW__))
+#include <immintrin.h>
+#endif
+
+namespace KERNEL_NS {
+
+// The largest sum is 255 * 10 = 2550, so 16-bit lanes are enough, and for
+// that range (x * 6554) >> 16 equals x / 10 exactly.
+static void weightedSum5(const unsigned char *a, const unsigned char *b, const unsigned char *c,
+                         const unsigned char *d, const unsigned char *e, unsigned char *dst, int n) {
+    int i = 0;
+
+#if !defined(KERNEL_SCALAR) && defined(__AVX512BW__)
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i magic = _mm512_set1_epi16(6554);
+    for (; i + 64 <= n; i += 64) {
+        __m512i va = _mm512_loadu_si512((const void *)(a + i));
+        __m512i vb = _mm512_loadu_si512((const void *)(b + i));
+        __m512i vc = _mm512_loadu_si512((const void *)(c + i));
+        __m512i vd = _mm512_loadu_si512((const void *)(d + i));
+        __m512i ve = _mm512_loadu_si512((const void *)(e + i));
+
+        // unpack and pack work per 128-bit lane, so the byte order survives the round trip
+        __m512i lo = _mm512_add_epi16(_mm512_unpacklo_epi8(va, zero), _mm512_unpacklo_epi8(ve, zero));
+        __m512i hi = _mm512_add_epi16(_mm512_unpackhi_epi8(va, zero), _mm512_unpackhi_epi8(ve, zero));
+        lo = _mm512_add_epi16(lo, _mm512_slli_epi16(_mm512_add_epi16(_mm512_unpacklo_epi8(vb, zero),
+                                                                     _mm512_unpacklo_epi8(vd, zero)), 1));
+        hi = _mm512_add_epi16(hi, _mm512_slli_epi16(_mm512_add_epi16(_mm512_unpackhi_epi8(vb, zero),
+                                                                     _mm512_unpackhi_epi8(vd, zero)), 1));
+        lo = _mm512_add_epi16(lo, _mm512_slli_epi16(_mm512_unpacklo_epi8(vc, zero), 2));
+        hi = _mm512_add_epi16(hi, _mm512_slli_epi16(_mm512_unpackhi_epi8(vc, zero), 2));
+
+        lo = _mm512_mulhi_epu16(lo, magic);
+        hi = _mm512_mulhi_epu16(hi, magic);
+        _mm512_storeu_si512((void *)(dst + i), _mm512_packus_epi16(lo, hi));
+    }
+#endif
+
+#if !defined(KERNEL_SCALAR) && defined(__AVX2__)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i magic = _mm256_set1_epi16(6554);
+        for (; i + 32 <= n; i += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+            __m256i vc = _mm256_loadu_si256((const __m256i *)(c + i));
+            __m256i vd = _mm256_loadu_si256((const __m256i *)(d + i));
+            __m256i ve = _mm256_loadu_si256((const __m256i *)(e + i));
+
+            __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(ve, zero));
+            __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(ve, zero));
+            lo = _mm256_add_epi16(lo, _mm256_slli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(vb, zero),
+                                                                         _mm256_unpacklo_epi8(vd, zero)), 1));
+            hi = _mm256_add_epi16(hi, _mm256_slli_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(vb, zero),
+                                                                         _mm256_unpackhi_epi8(vd, zero)), 1));
+            lo = _mm256_add_epi16(lo, _mm256_slli_epi16(_mm256_unpacklo_epi8(vc, zero), 2));
+            hi = _mm256_add_epi16(hi, _mm256_slli_epi16(_mm256_unpackhi_epi8(vc, zero), 2));
+
+            lo = _mm256_mulhi_epu16(lo, magic);
+            hi = _mm256_mulhi_epu16(hi, magic);
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+        }
+    }
+#endif
+
+#if !defined(KERNEL_SCALAR) && defined(__SSE4_1__)
+    {
+        const __m128i magic = _mm_set1_epi16(6554);
+        for (; i + 8 <= n; i += 8) {
+            __m128i va = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(a + i)));
+            __m128i vb = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(b + i)));
+            __m128i vc = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(c + i)));
+            __m128i vd = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(d + i)));
+            __m128i ve = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(e + i)));
+
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(va, ve), _mm_slli_epi16(_mm_add_epi16(vb, vd), 1));
+            sum = _mm_add_epi16(sum, _mm_slli_epi16(vc, 2));
+            sum = _mm_mulhi_epu16(sum, magic);
+            _mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(sum, sum));
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        dst[i] = (unsigned char)((a[i] + 2 * b[i] + 4 * c[i] + 2 * d[i] + e[i]) / 10);
+    }
+}
+
+// gx^2 + gy^2 is at most 2 * 255^2, exact in a float, and sqrtps rounds the
+// same way sqrtf does; cvtps_epi32 rounds half to even like cvRound and lrintf.
+static void gradientMag(const unsigned char *up, const unsigned char *mid, const unsigned char *down,
+                        unsigned char *dst, int n, int cn) {
+    int i = 0;
+
+#if !defined(KERNEL_SCALAR) && defined(__AVX512BW__)
+    for (; i + 32 <= n; i += 32) {
+        __m512i right = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(mid + i + cn)));
+        __m512i left = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(mid + i - cn)));
+        __m512i below = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(down + i)));
+        __m512i above = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(up + i)));
+        __m512i gx = _mm512_sub_epi16(right, left);
+        __m512i gy = _mm512_sub_epi16(below, above);
+
+        // pairs (gx, gy) multiplied and added in one step give gx^2 + gy^2 as int32
+        __m512i pl = _mm512_unpacklo_epi16(gx, gy), ph = _mm512_unpackhi_epi16(gx, gy);
+        __m512i sl = _mm512_cvtps_epi32(_mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(pl, pl))));
+        __m512i sh = _mm512_cvtps_epi32(_mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(ph, ph))));
+        // packs undoes the per-lane unpack order; the values are 0..361
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm512_cvtusepi16_epi8(_mm512_packs_epi32(sl, sh)));
+    }
+#endif
+
+#if !defined(KERNEL_SCALAR) && defined(__AVX2__)
+    for (; i + 16 <= n; i += 16) {
+        __m256i right = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(mid + i + cn)));
+        __m256i left = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(mid + i - cn)));
+        __m256i below = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(down + i)));
+        __m256i above = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(up + i)));
+        __m256i gx = _mm256_sub_epi16(right, left);
+        __m256i gy = _mm256_sub_epi16(below, above);
+
+        __m256i pl = _mm256_unpacklo_epi16(gx, gy), ph = _mm256_unpackhi_epi16(gx, gy);
+        __m256i sl = _mm256_cvtps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(pl, pl))));
+        __m256i sh = _mm256_cvtps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(ph, ph))));
+        __m256i v = _mm256_packs_epi32(sl, sh);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128((__m128i *)(dst + i), bytes);
+    }
+#endif
+
+#if !defined(KERNEL_SCALAR) && defined(__SSE4_1__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i right = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(mid + i + cn)));
+        __m128i left = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(mid + i - cn)));
+        __m128i below = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(down + i)));
+        __m128i above = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(up + i)));
+        __m128i gx = _mm_sub_epi16(right, left);
+        __m128i gy = _mm_sub_epi16(below, above);
+
+        __m128i pl = _mm_unpacklo_epi16(gx, gy), ph = _mm_unpackhi_epi16(gx, gy);
+        __m128i sl = _mm_cvtps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(pl, pl))));
+        __m128i sh = _mm_cvtps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(ph, ph))));
+        __m128i v = _mm_packs_epi32(sl, sh);
+        _mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(v, v));
+    }
+#endif
+
+    for (; i < n; i++) {
+        float fx = mid[i + cn] - mid[i - cn];
+        float fy = down[i] - up[i];
+        long v = lrintf(sqrtf(fx * fx + fy * fy));
+        dst[i] = (unsigned char)(v > 255 ? 255 : v);
+    }
+}
+
+extern const FilterKernels kernels;
+const FilterKernels kernels = {KERNEL_ISA_NAME, weightedSum5, gradientMag};
+
+} // namespace KERNEL_NS
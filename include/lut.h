@@ -0,0 +1,51 @@
+/**
+ * @file lut.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief lookup tables for the point-wise colour filters
+ * @version 0.1
+ * @date 2024-02-26
+*/
+
+#ifndef LUT_H
+#define LUT_H
+
+#include <opencv2/opencv.hpp>
+
+// The 8-bit tables below are 1 x 256 CV_8U Mats, applied with applyLut.
+
+// x itself
+const cv::Mat &identityLut();
+
+// 255 - x, for the negative filter
+const cv::Mat &negativeLut();
+
+// the bucket start of x for levels buckets (levels in 1..255), as in blurQuantize
+int quantizeLut(int levels, cv::Mat &lut);
+
+// saturate_cast<uchar>(x * alpha + beta), the table convertTo(-1, alpha, beta) applies
+void affineLut(double alpha, double beta, cv::Mat &lut);
+
+// lut(x) = second(first(x))
+void composeLut(const cv::Mat &first, const cv::Mat &second, cv::Mat &lut);
+
+// apply a 256-entry table to every channel of an 8-bit image; dst may be src
+int applyLut(cv::Mat &src, cv::Mat &dst, const cv::Mat &lut);
+
+// (b + g + r) / 3 indexed by the sum b + g + r (0..765), for greyscale
+const uchar *greyAverageTable();
+
+// Per-channel contributions of the sepia matrix. Output channel c (BGR) is
+// red[c][r] + green[c][g] + blue[c][b], summed in that order so the result
+// matches the per-pixel dot product bit for bit.
+struct SepiaTables {
+    double red[3][256];
+    double green[3][256];
+    double blue[3][256];
+};
+const SepiaTables &sepiaTables();
+
+// Vignette weight max(0, 1 - distance to the centre / corner distance) of
+// every pixel as a CV_64FC1 map; the map of the last size asked for is cached.
+cv::Mat vignetteMap(cv::Size size);
+
+#endif // LUT_H
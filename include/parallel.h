@@ -0,0 +1,26 @@
+/**
+ * @file parallel.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row-band parallel execution for the filters
+ * @version 0.1
+ * @date 2024-02-12
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+// set the number of threads the filters may use, 0 means one per core
+void setFilterThreads(int n);
+
+// number of threads the filters currently use
+int getFilterThreads();
+
+// Split the rows [begin, end) into horizontal bands and run body(y0, y1) on
+// each band, in parallel when more than one thread is available. Bands are at
+// least minRows tall. Stencil filters read their halo rows straight from the
+// (unchanged) source, so a band only ever writes its own rows.
+void parallelRows(int begin, int end, const std::function<void(int, int)> &body, int minRows = 8);
+
+#endif // PARALLEL_H
@@ -0,0 +1,82 @@
+/**
+ * @file pipeline.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief chain of filter stages built from a spec string
+ * @version 0.1
+ * @date 2024-02-14
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "profiler.h"
+
+// per-frame data shared by the stages, e.g. the faces found by the "face" stage
+struct FrameContext {
+    std::vector<cv::Rect> faces;
+    long long frameIndex = 0;  // set by the caller, passed on to async detection
+    double timestamp = 0.0;    // capture time in seconds (cv::getTickCount based)
+    bool realtime = true;      // false (offline, e.g. batch): stages wait for background
+                               // work such as async face detection instead of skipping it
+};
+
+// key=value options of a stage, e.g. {"levels": "15"}
+typedef std::map<std::string, std::string> StageParams;
+
+// one step of the chain; run() reads src and writes dst, which never alias
+struct FilterStage {
+    std::string name;
+    StageParams params;
+    std::function<int(cv::Mat &src, cv::Mat &dst, FrameContext &ctx)> run;
+    std::function<void()> reset;  // drop what earlier frames left, e.g. face tracks; may be empty
+    StageHistogram *timer = NULL; // "stage <name>" in the profiler
+    bool planar = false;          // run() also works on a single CV_8UC1 plane
+};
+
+// An ordered chain of filters, built from a spec such as
+// "sepia|blur|cartoon:levels=15,threshold=20". Stages ping-pong between two
+// buffers owned by the pipeline, so once they have the frame size no memory
+// is allocated per frame.
+//
+// A spec that starts with "planar", e.g. "planar|blur|magnitude", splits the
+// frame into one plane per channel on entry, runs every stage on each plane
+// and merges them once at the end; all its stages must support planes.
+class FilterPipeline {
+public:
+    // replace the chain with the one described by spec ("" = pass-through);
+    // on error the old chain is kept and error (if given) says why
+    bool parse(const std::string &spec, std::string *error = NULL);
+
+    // run every stage on src. dst ends up sharing the pipeline's last buffer
+    // (or src for an empty chain), so copy it if it must outlive the next call.
+    // Returns -1 if a stage fails, e.g. a colour filter after "gray".
+    int process(cv::Mat &src, cv::Mat &dst, FrameContext &ctx);
+
+    // forget everything earlier frames left in the stages (face tracks,
+    // pending detections), so the next frame starts an unrelated input
+    void reset();
+
+    const std::string &spec() const { return spec_; }
+    bool planar() const { return planar_; }
+    bool empty() const { return stages_.empty(); }
+    const std::vector<FilterStage> &stages() const { return stages_; }
+
+    // names accepted in a spec, for usage messages
+    static std::vector<std::string> stageNames();
+
+private:
+    int processPlanes(cv::Mat &src, cv::Mat &dst, FrameContext &ctx);
+
+    std::vector<FilterStage> stages_;
+    cv::Mat buffers_[2];
+    std::vector<cv::Mat> planes_[2];
+    std::string spec_;
+    bool planar_ = false;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,99 @@
+/**
+ * @file profiler.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief scoped stage timers with per-stage histograms, an overlay and CSV / JSON dumps
+ * @version 0.1
+ * @date 2024-03-03
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Timers only read the clock while profiling is on; when it is off a probe
+// costs one relaxed atomic load and a branch.
+extern std::atomic<bool> profilingOn;
+
+inline bool profilingEnabled() {
+    return profilingOn.load(std::memory_order_relaxed);
+}
+
+void setProfiling(bool on);
+
+// Durations of one stage on a log scale: four buckets per doubling of the
+// time, from 1 microsecond up to about 70 seconds. Safe to record from any thread.
+class StageHistogram {
+public:
+    static const int kBuckets = 104;
+
+    explicit StageHistogram(const std::string &name) : name_(name) { reset(); }
+
+    void record(double ms);
+    void reset();
+
+    const std::string &name() const { return name_; }
+    long long count() const { return count_.load(std::memory_order_relaxed); }
+    double totalMs() const { return totalUs_.load(std::memory_order_relaxed) / 1000.0; }
+    double maxMs() const { return maxUs_.load(std::memory_order_relaxed) / 1000.0; }
+    // estimate of the value below which fraction q (0..1) of the samples fall
+    double percentileMs(double q) const;
+
+private:
+    std::string name_;
+    std::atomic<long long> buckets_[kBuckets];
+    std::atomic<long long> count_, totalUs_, maxUs_;
+};
+
+// The histogram of a stage, created on first use and kept for the whole run.
+StageHistogram &profileStage(const std::string &name);
+
+// Times the enclosing scope into a stage histogram.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(StageHistogram &stage) : stage_(profilingEnabled() ? &stage : NULL) {
+        if (stage_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~ScopedTimer() {
+        if (stage_) {
+            stage_->record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count());
+        }
+    }
+
+private:
+    StageHistogram *stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// PROFILE_SCOPE("blur5x5_2"); times the rest of the block; the stage lookup is done once per call site
+#define PROFILE_SCOPE(name) \
+    static StageHistogram &PROFILE_CONCAT(profileStage_, __LINE__) = profileStage(name); \
+    ScopedTimer PROFILE_CONCAT(profileTimer_, __LINE__)(PROFILE_CONCAT(profileStage_, __LINE__))
+
+struct StageSummary {
+    std::string name;
+    long long count;
+    double meanMs, p50Ms, p95Ms, p99Ms, maxMs;
+};
+
+// every stage that has samples, in the order the stages were first used
+std::vector<StageSummary> profileSummary();
+
+// clear every histogram
+void resetProfile();
+
+// write the summary; a path ending in .csv gives CSV, anything else JSON
+int writeProfile(const std::string &path);
+
+// frame rate and per-stage times drawn in the top left corner of frame
+void drawProfileOverlay(cv::Mat &frame, double fps);
+
+#endif // PROFILER_H
@@ -0,0 +1,55 @@
+/**
+ * @file proxy.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief run a filter at reduced resolution and upsample its result
+ * @version 0.1
+ * @date 2024-03-08
+*/
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <vector>
+
+struct ProxyParams {
+    int factor = 2;      // the filter sees 1/factor of the width and height; 1 = full size
+    bool guided = false; // edge-aware upsampling with the full-size frame as the guide
+    int radius = 2;      // guided: window radius, in proxy pixels
+    float eps = 50.0f;   // guided: regularisation in 8-bit units squared; larger blurs edges more
+};
+
+typedef std::function<int(cv::Mat &src, cv::Mat &dst)> ProxyFilterFn;
+
+// Runs a filter on a downscaled copy of the frame and brings its result back
+// to full size. Plain upsampling is bilinear. Guided upsampling fits
+// out = a * in + b per channel over small windows at proxy size (a guided
+// filter), then interpolates a and b and applies them to the full-size
+// frame, so edges stay as sharp as in the source. Scratch buffers are kept
+// between calls; one ProxyFilter per thread.
+class ProxyFilter {
+public:
+    explicit ProxyFilter(const ProxyParams &params = ProxyParams()) : params_(params) {}
+
+    // dst gets the size of src; returns what filter returns, -1 on an empty frame.
+    // Guided upsampling needs an 8-bit result with as many channels as src;
+    // other results are upsampled bilinearly.
+    int apply(cv::Mat &src, cv::Mat &dst, const ProxyFilterFn &filter);
+
+    const ProxyParams &params() const { return params_; }
+
+private:
+    void fitLinearModel();
+    void guidedUpsample(const cv::Mat &guide, cv::Mat &dst);
+
+    ProxyParams params_;
+    cv::Mat small_, smallOut_;
+    // per proxy pixel and channel: the local linear model, and box-filter scratch
+    std::vector<float> a_, b_, ii_, ip_, tmp_;
+    // full-size column -> the two proxy columns and the weight of the second
+    std::vector<int> x0_, x1_;
+    std::vector<float> wx_;
+};
+
+#endif // PROXY_H
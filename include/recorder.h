@@ -0,0 +1,105 @@
+/**
+ * @file recorder.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief video recording on a background thread, with a choice of codecs
+ * @version 0.1
+ * @date 2024-03-09
+*/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frameQueue.h"
+
+enum RecordCodec {
+    RECORD_MJPG, // motion JPEG in .avi, always available
+    RECORD_H264, // H.264 in .mp4, through whichever encoder the FFmpeg backend has
+    RECORD_FFV1  // lossless FFV1 in .mkv
+};
+
+// "mjpg", "h264" or "ffv1" -> codec; false for anything else
+bool parseRecordCodec(const std::string &name, RecordCodec &codec);
+
+// file extension the codec is written with, without the dot
+const char *recordExtension(RecordCodec codec);
+
+// Open writer for codec, trying the FFmpeg backend first and then any other;
+// H.264 tries the fourccs the different builds know it by. On success the
+// accepted fourcc is stored in fourcc (when not NULL).
+bool openVideoWriter(cv::VideoWriter &writer, const std::string &path, RecordCodec codec,
+                     double fps, cv::Size size, bool isColor, std::string *fourcc = NULL);
+
+// what one recording produced
+struct RecorderStats {
+    std::string path;
+    std::string fourcc;     // as accepted by the backend, empty if the file never opened
+    cv::Size size;          // of the frames in the file
+    int channels = 0;
+    double fps = 0.0;       // frame rate the file was opened with
+    long long written = 0;
+    long long dropped = 0;  // evicted from the queue because the encoder fell behind
+};
+
+// An encoder thread fed from a bounded frame queue. push() copies a frame
+// into a recycled buffer and never waits: when the queue is full the oldest
+// frame is dropped and counted. The file is opened on the encoder thread
+// with the size and channel count of the first frame, at the given frame
+// rate or, without one, at the rate measured from the timestamps of the
+// first frames. Frames that change format mid-recording (another filter
+// mode) are converted to the format of the file.
+class AsyncRecorder {
+public:
+    explicit AsyncRecorder(size_t queueSize = 8);
+    ~AsyncRecorder();
+
+    // begin a new file; fps <= 0 measures it. Returns false while a previous
+    // recording is still being closed, which stop() waits for.
+    bool start(const std::string &path, RecordCodec codec, double fps = 0.0);
+
+    // write the frames still queued, close the file and return its stats
+    RecorderStats stop();
+
+    bool recording() const { return state_ == RECORDING; }
+
+    // queue a copy of frame, scaled to size unless that is empty;
+    // ignored when not recording
+    void push(const cv::Mat &frame, long long index, double timestamp, cv::Size size = cv::Size());
+
+private:
+    enum State { IDLE, RECORDING, CLOSING };
+
+    void run();
+    void encode(Frame &f);
+    bool openFile();
+    void writeFrame(const cv::Mat &image);
+    void finish();
+
+    BoundedQueue<Frame> queue_;
+    BoundedQueue<cv::Mat> free_;
+
+    // state_ changes under lock_ and push() enqueues under it too, so
+    // nothing is queued once a recording is closing
+    mutable std::mutex lock_;
+    std::condition_variable ready_, closed_;
+    std::atomic<int> state_;
+    RecorderStats stats_;
+    RecordCodec codec_;
+    bool stop_;
+
+    // encoder thread only
+    cv::VideoWriter writer_;
+    std::vector<Frame> preroll_;  // frames held back while the frame rate is measured
+    bool failed_;                 // the file would not open; frames are discarded until stop()
+    cv::Mat converted_, resized_;
+
+    std::thread worker_;
+};
+
+#endif // RECORDER_H
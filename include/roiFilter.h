@@ -0,0 +1,66 @@
+/**
+ * @file roiFilter.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief run a filter only inside or only outside a list of rectangles
+ * @version 0.1
+ * @date 2024-03-12
+*/
+
+#ifndef ROIFILTER_H
+#define ROIFILTER_H
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <utility>
+#include <vector>
+
+enum RoiMode {
+    ROI_INSIDE,  // filter the rectangles (e.g. the faces), keep the rest
+    ROI_OUTSIDE  // filter everything but the rectangles (the background)
+};
+
+struct RoiParams {
+    RoiMode mode = ROI_INSIDE;
+    int margin = 0;          // the rectangles grow by this many pixels on every side
+    int halo = 4;            // source pixels around each piece that reach into it; 4 covers the 5x5
+                             // stencils, whose keep border reaches two pixels further in
+    bool wholeFrame = false; // outside: filter the full frame once and put the rectangles back, for
+                             // filters that are cheap on the full frame (e.g. at proxy resolution)
+};
+
+typedef std::function<int(cv::Mat &src, cv::Mat &dst)> RoiFilterFn;
+
+// Runs a filter on the parts of a frame that a list of rectangles, such as
+// the faces from detectFaces, selects. The affected area is cut into
+// disjoint rectangular pieces along the rectangle edges; each piece is
+// filtered together with a halo of its neighbours, so a stencil sees the same
+// pixels as on the full frame, and only the piece is kept. The filter work is
+// proportional to the affected area, not to the frame.
+//
+// The filter must keep the type of the frame. With dst == src only the
+// affected pixels are written; otherwise the untouched ones are copied.
+// Scratch buffers are kept between calls; one RoiFilter per thread.
+class RoiFilter {
+public:
+    explicit RoiFilter(const RoiParams &params = RoiParams()) : params_(params) {}
+
+    // returns what filter returns, -1 on an empty frame or a filter that changes its type
+    int apply(cv::Mat &src, cv::Mat &dst, const std::vector<cv::Rect> &rects, const RoiFilterFn &filter);
+
+    // the pieces the last apply() filtered, in frame coordinates
+    const std::vector<cv::Rect> &pieces() const { return pieces_; }
+
+    const RoiParams &params() const { return params_; }
+
+private:
+    void cutPieces(const std::vector<cv::Rect> &rects, cv::Size size);
+
+    RoiParams params_;
+    std::vector<cv::Rect> grown_;             // the rectangles grown by the margin, clipped
+    std::vector<cv::Rect> regions_, outside_; // their union and the rest, as disjoint pieces
+    std::vector<cv::Rect> pieces_;            // the ones filtered
+    std::vector<std::pair<int, int> > spans_;
+    std::vector<cv::Mat> outs_;               // filtered piece plus halo, one per piece
+};
+
+#endif // ROIFILTER_H
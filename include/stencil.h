@@ -0,0 +1,191 @@
+/**
+ * @file stencil.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief small convolution kernels fixed at compile time
+ * @version 0.1
+ * @date 2024-03-06
+*/
+
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// The coefficients are template arguments, so every tap is a constant the
+// compiler can fold: zero taps vanish, the recursion unrolls completely and a
+// constant divisor such as 100 or 10 becomes a multiply and a shift. A new
+// stencil is one typedef away and runs as fast as a hand-written loop.
+//
+//   typedef Kernel2D<Taps<1, 2, 1>, Taps<2, 4, 2>, Taps<1, 2, 1> > Gauss3x3;
+//   applyStencil<Gauss3x3, 3, int, Gauss3x3::sum, uchar, uchar>(in, dst, y0, y1, STENCIL_BORDER_REFLECT);
+
+// One row of coefficients, left to right.
+template <int... K>
+struct Taps;
+
+template <>
+struct Taps<> {
+    static constexpr int size = 0;
+    static constexpr int sum = 0;
+
+    template <int Stride, typename Acc, typename T>
+    static inline Acc dot(const T *) { return Acc(0); }
+};
+
+template <int K0, int... K>
+struct Taps<K0, K...> {
+    static constexpr int size = 1 + sizeof...(K);
+    static constexpr int sum = K0 + Taps<K...>::sum;
+
+    // sum of K[j] * p[j * Stride]
+    template <int Stride, typename Acc, typename T>
+    static inline Acc dot(const T *p) {
+        return Acc(K0) * Acc(p[0]) + Taps<K...>::template dot<Stride, Acc>(p + Stride);
+    }
+};
+
+// A 2-D kernel, one Taps per row from top to bottom; all rows are as wide.
+template <class... Rows>
+struct Kernel2D;
+
+template <>
+struct Kernel2D<> {
+    static constexpr int rows = 0;
+    static constexpr int cols = 0;
+    static constexpr int sum = 0;
+
+    template <int Stride, typename Acc, typename T>
+    static inline Acc dot(const T *const *, int) { return Acc(0); }
+};
+
+template <class R0, class... R>
+struct Kernel2D<R0, R...> {
+    static_assert(Kernel2D<R...>::rows == 0 || Kernel2D<R...>::cols == R0::size,
+                  "every row of a kernel needs the same number of taps");
+
+    static constexpr int rows = 1 + sizeof...(R);
+    static constexpr int cols = R0::size;
+    static constexpr int sum = R0::sum + Kernel2D<R...>::sum;
+
+    // sum over the kernel of K[k][j] * src[k][i + j * Stride]
+    template <int Stride, typename Acc, typename T>
+    static inline Acc dot(const T *const *src, int i) {
+        return R0::template dot<Stride, Acc>(src[0] + i) + Kernel2D<R...>::template dot<Stride, Acc>(src + 1, i);
+    }
+};
+
+// the separable halves: Row<1, 2, 1> is 1 x 3, Column<1, 2, 1> is 3 x 1
+template <int... K>
+using Row = Kernel2D<Taps<K...> >;
+template <int... K>
+using Column = Kernel2D<Taps<K>...>;
+
+// How a stencil treats the pixels whose neighbourhood runs off the image.
+enum StencilBorder {
+    STENCIL_BORDER_KEEP,      // copy the source pixel, the original blur5x5 look
+    STENCIL_BORDER_REPLICATE, // aaa|abcd|ddd
+    STENCIL_BORDER_REFLECT,   // cb|abcd|cb, mirrored about the edge pixel
+    STENCIL_BORDER_CONSTANT   // 000|abcd|000
+};
+
+// the source index that position p of an axis of length n reads, -1 for the
+// constant border; never called for STENCIL_BORDER_KEEP
+inline int borderIndex(int p, int n, int border) {
+    if (p >= 0 && p < n) {
+        return p;
+    }
+    if (border == STENCIL_BORDER_CONSTANT) {
+        return -1;
+    }
+    if (border == STENCIL_BORDER_REPLICATE || n == 1) {
+        return p < 0 ? 0 : n - 1;
+    }
+    // reflect again for kernels wider than the image
+    while (p < 0 || p >= n) {
+        p = p < 0 ? -p : 2 * (n - 1) - p;
+    }
+    return p;
+}
+
+// n output pixels over interleaved rows with CN channels: src[k] points at
+// the top left tap of the first output pixel, in kernel row k.
+template <class Kernel, int CN, typename Acc, int Div, typename Src, typename Dst>
+inline void stencilRow(const Src *const *src, Dst *dst, int n) {
+    static_assert(Div != 0, "the divisor of a stencil cannot be 0");
+    // a local copy of the row pointers stays in registers; stores to dst
+    // could otherwise alias the caller's array and force reloads
+    const Src *rows[Kernel::rows];
+    for (int k = 0; k < Kernel::rows; k++) {
+        rows[k] = src[k];
+    }
+    for (int i = 0, end = n * CN; i < end; i++) {
+        dst[i] = static_cast<Dst>(Kernel::template dot<CN, Acc>(rows, i) / Div);
+    }
+}
+
+// Pixels [x0, x1) of row y whose neighbourhood leaves the image: computed
+// from a padded copy of just that neighbourhood.
+template <class Kernel, int CN, typename Acc, int Div, typename Src, typename Dst>
+void stencilEdge(const cv::Mat &in, Dst *dst, int y, int x0, int x1, int border) {
+    if (x1 <= x0) {
+        return;
+    }
+    if (border == STENCIL_BORDER_KEEP) {
+        const Src *s = in.ptr<Src>(y);
+        for (int i = x0 * CN; i < x1 * CN; i++) {
+            dst[i] = static_cast<Dst>(s[i]);
+        }
+        return;
+    }
+
+    const int rx = Kernel::cols / 2, ry = Kernel::rows / 2;
+    const int width = (x1 - x0 + 2 * rx) * CN;
+    static thread_local std::vector<Src> padded;
+    padded.assign((size_t)Kernel::rows * width, Src(0));
+
+    const Src *src[Kernel::rows];
+    for (int k = 0; k < Kernel::rows; k++) {
+        Src *row = &padded[(size_t)k * width];
+        src[k] = row;
+        int sy = borderIndex(y - ry + k, in.rows, border);
+        if (sy < 0) {
+            continue;
+        }
+        const Src *s = in.ptr<Src>(sy);
+        for (int x = 0; x < x1 - x0 + 2 * rx; x++) {
+            int sx = borderIndex(x0 - rx + x, in.cols, border);
+            for (int c = 0; sx >= 0 && c < CN; c++) {
+                row[x * CN + c] = s[sx * CN + c];
+            }
+        }
+    }
+    stencilRow<Kernel, CN, Acc, Div>(src, dst + x0 * CN, x1 - x0);
+}
+
+// Rows [y0, y1) of dst = in convolved with Kernel and divided by Div. Rows and
+// columns whose neighbourhood is inside the image go straight through
+// stencilRow; only the Kernel::rows / 2 rows at the top and bottom and the
+// Kernel::cols / 2 pixels at either end of a row take the border pass.
+template <class Kernel, int CN, typename Acc, int Div, typename Src, typename Dst>
+void applyStencil(const cv::Mat &in, cv::Mat &dst, int y0, int y1, int border) {
+    const int rx = Kernel::cols / 2, ry = Kernel::rows / 2;
+    const int rows = in.rows, cols = in.cols;
+    const Src *src[Kernel::rows];
+
+    for (int y = y0; y < y1; y++) {
+        Dst *d = dst.ptr<Dst>(y);
+        if (y < ry || y >= rows - ry || cols <= 2 * rx) {
+            stencilEdge<Kernel, CN, Acc, Div, Src>(in, d, y, 0, cols, border);
+            continue;
+        }
+        for (int k = 0; k < Kernel::rows; k++) {
+            src[k] = in.ptr<Src>(y - ry + k);
+        }
+        stencilRow<Kernel, CN, Acc, Div>(src, d + rx * CN, cols - 2 * rx);
+        stencilEdge<Kernel, CN, Acc, Div, Src>(in, d, y, 0, rx, border);
+        stencilEdge<Kernel, CN, Acc, Div, Src>(in, d, y, cols - rx, cols, border);
+    }
+}
+
+#endif // STENCIL_H
@@ -0,0 +1,121 @@
+/**
+ * @file streamServer.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief many cameras / video files filtered at once over a shared worker pool
+ * @version 0.1
+ * @date 2024-03-10
+*/
+
+#ifndef STREAMSERVER_H
+#define STREAMSERVER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frameQueue.h"
+#include "pipeline.h"
+#include "profiler.h"
+
+struct StreamConfig {
+    std::string source;  // device index ("0", "1", ...) or video file
+    std::string spec;    // filter chain, as in FilterPipeline::parse
+    bool pace = true;    // read files at their own frame rate, like a camera; false = every frame, as fast as possible
+    bool loop = false;   // start a file again at its end instead of ending the stream
+};
+
+// what one stream has done so far
+struct StreamStats {
+    int id = 0;
+    std::string source;
+    long long frames = 0;   // processed
+    long long dropped = 0;  // replaced in the input queue before a worker got to them
+    long long failed = 0;   // the chain returned an error
+    double fps = 0.0;       // processed frames per second over the last report interval
+    double latencyP50Ms = 0.0, latencyP95Ms = 0.0, latencyMaxMs = 0.0; // capture to filtered
+    bool ended = false;     // the source has no more frames and the queue is empty
+};
+
+// Every stream has its own capture thread, filter pipeline and frame
+// context, so face tracks and other per-stage state never mix between
+// streams. The pipelines run on a shared pool of workers that take the
+// streams in turn, one frame per turn: a stream is never processed by two
+// workers at once (its frames stay in order) and a fast source cannot take
+// the workers away from a slow one. A live stream keeps only the newest two
+// captured frames; older ones are dropped and counted, as in vidDisplay.
+class StreamServer {
+public:
+    // workers <= 0: one per core, at most one per stream; keepLatest makes
+    // latest() available, at the cost of one copy per frame
+    explicit StreamServer(int workers = 0, bool keepLatest = false);
+    ~StreamServer();
+
+    // open a stream before start(); returns its id, or -1 with error set
+    int addStream(const StreamConfig &config, std::string *error = NULL);
+
+    void start();
+    void stop();
+
+    size_t streamCount() const { return streams_.size(); }
+    // the resolved count once started
+    int workerCount() const { return workerCount_; }
+
+    // true once every stream has ended and its frames are processed
+    bool finished() const;
+
+    // per-stream stats; fps covers the time since the previous call
+    std::vector<StreamStats> stats();
+
+    // copy of the newest filtered frame of a stream; false if there is none yet
+    bool latest(int id, cv::Mat &frame) const;
+
+private:
+    struct Stream {
+        Stream() : latency("latency") {}
+        // the queues are cache-line aligned, which plain new does not honour
+        // before C++17; cv::fastMalloc aligns to 64 bytes
+        static void *operator new(size_t size) { return cv::fastMalloc(size); }
+        static void operator delete(void *p) { cv::fastFree(p); }
+
+        int id = 0;
+        StreamConfig config;
+        cv::VideoCapture capture;
+        double sourceFps = 0.0;
+        bool live = true;  // drop frames the workers cannot keep up with
+        std::thread reader;
+
+        BoundedQueue<Frame> captured{2};
+        BoundedQueue<cv::Mat> freeCaptured{4};
+        std::atomic<bool> busy{false};   // claimed by a worker
+        std::atomic<bool> ended{false};  // the reader has stopped
+
+        // touched only by the worker holding busy
+        FilterPipeline pipeline;
+        FrameContext context;
+
+        std::atomic<long long> read{0}, frames{0}, dropped{0}, failed{0};
+        StageHistogram latency;
+        long long reportedFrames = 0;  // frames at the previous stats() call
+
+        mutable std::mutex outLock;
+        cv::Mat latest;
+    };
+
+    void readLoop(Stream *s);
+    void workLoop();
+    bool runOnce(Stream &s);
+    static bool drained(const Stream &s);
+
+    std::vector<std::unique_ptr<Stream> > streams_;
+    std::vector<std::thread> workers_;
+    int workerCount_;
+    bool keepLatest_;
+    std::atomic<bool> running_;
+    std::atomic<size_t> next_;  // round-robin cursor over the streams
+    double lastReport_;
+};
+
+#endif // STREAMSERVER_H
@@ -0,0 +1,42 @@
+/**
+ * @file toneAdjust.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief brightness / contrast adjustment through a single 256-entry table
+ * @version 0.1
+ * @date 2024-02-27
+*/
+
+#ifndef TONEADJUST_H
+#define TONEADJUST_H
+
+#include <opencv2/opencv.hpp>
+
+// Brightness and contrast as one lookup per byte. The table is what the
+// original four-step adjustment (convertTo, += brightness, *= contrast)
+// does to each value, and is only rebuilt when the settings change.
+class ToneAdjust {
+public:
+    ToneAdjust();
+
+    // returns true when the settings changed and the table was rebuilt
+    bool set(float brightness, float contrast);
+
+    // Optionally stretch the adjusted frame to the full 0..255 range, as
+    // cv::normalize(NORM_MINMAX) did. This needs a min/max pass per frame.
+    void setStretch(bool stretch) { stretch_ = stretch; }
+
+    // true when apply would leave every pixel unchanged
+    bool identity() const { return identity_ && !stretch_; }
+
+    // adjust an 8-bit image, dst may be src; returns -1 on a non 8-bit image
+    int apply(cv::Mat &src, cv::Mat &dst);
+
+private:
+    float brightness_, contrast_;
+    bool stretch_;
+    bool identity_;
+    cv::Mat lut_;
+    cv::Mat frameLut_; // lut_ followed by the stretch of the current frame
+};
+
+#endif // TONEADJUST_H
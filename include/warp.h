@@ -0,0 +1,60 @@
+/**
+ * @file warp.h
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief sine-wave warp with a cached displacement table
+ * @version 0.1
+ * @date 2024-02-28
+*/
+
+#ifndef WARP_H
+#define WARP_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+enum WarpSampling {
+    WARP_NEAREST,  // whole-pixel displacement, the original warpImage look
+    WARP_BILINEAR  // sub-pixel displacement, blended between two source pixels
+};
+
+struct WarpParams {
+    // true: rows move by amplitude * sin(2 pi x / frequency + phase) (the 'w' key),
+    // false: columns move by the same wave over y (the 'v' key)
+    bool horizontal = true;
+    double amplitude = 200;
+    double frequency = 100;
+    double phase = 0;      // advance it frame by frame to animate the wave
+    WarpSampling sampling = WARP_NEAREST;
+};
+
+// The displacement only depends on x (horizontal) or y (vertical), so it is a
+// single table built once per size and parameters and reused for every frame.
+// The trig is done once per size and frequency: a new phase (an animated
+// wave) only combines the cached sine and cosine of every column or row.
+class WarpEngine {
+public:
+    // warp an 8-bit 3-channel image; pixels mapped from outside the image are black.
+    // dst may be src. Returns -1 on a bad image.
+    int apply(cv::Mat &src, cv::Mat &dst, const WarpParams &params);
+
+private:
+    void build(cv::Size size, size_t step, const WarpParams &params);
+
+    // what the table was built for
+    cv::Size size_;
+    size_t step_ = 0;
+    WarpParams params_;
+
+    std::vector<double> sin_, cos_; // sin / cos of 2 pi i / frequency, for any phase
+    int length_ = -1;               // what sin_ and cos_ were built for
+    double frequency_ = 0;
+    std::vector<int> shift_;        // whole-pixel displacement per column / row
+    std::vector<int> weight_;       // bilinear: weight of the next pixel, 0..255
+
+    // horizontal: byte offset of every column's source pixel from its own
+    // row, and the rows [rowBegin_, rowEnd_) where no column reads outside
+    std::vector<ptrdiff_t> offset_;
+    int rowBegin_ = 0, rowEnd_ = 0;
+};
+
+#endif // WARP_H
@@ -0,0 +1,136 @@
+/**
+ * @file asyncFaceDetect.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief face detection on a background thread, off the render path
+ * @version 0.1
+ * @date 2024-02-24
+*/
+
+#include <opencv2/opencv.hpp>
+#include "asyncFaceDetect.h"
+#include "profiler.h"
+
+static double now() {
+    return cv::getTickCount() / cv::getTickFrequency();
+}
+
+AsyncFaceDetector::AsyncFaceDetector(double scale, const FaceTrackerParams &params)
+    : scale_(scale > 0 ? scale : 1.0), tracker_(params), pendingIndex_(-1), pendingTime_(0.0),
+      hasPending_(false), stop_(false), resetTracks_(false), hasResult_(false), generation_(0) {
+    worker_ = std::thread(&AsyncFaceDetector::run, this);
+}
+
+AsyncFaceDetector::~AsyncFaceDetector() {
+    {
+        std::lock_guard<std::mutex> guard(inLock_);
+        stop_ = true;
+    }
+    inReady_.notify_one();
+    worker_.join();
+}
+
+void AsyncFaceDetector::submit(const cv::Mat &frame, long long frameIndex, double timestamp) {
+    if (frame.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(inLock_);
+        // the shrunk copy is all the worker needs, and cheaper than a full copy
+        cv::resize(frame, pending_, cv::Size(), scale_, scale_, cv::INTER_AREA);
+        pendingIndex_ = frameIndex;
+        pendingTime_ = timestamp;
+        hasPending_ = true;
+    }
+    inReady_.notify_one();
+}
+
+bool AsyncFaceDetector::latest(FaceResult &result) const {
+    std::unique_lock<std::mutex> guard(outLock_, std::try_to_lock);
+    if (!guard.owns_lock() || !hasResult_) {
+        return false;
+    }
+    result = result_;
+    return true;
+}
+
+bool AsyncFaceDetector::wait(long long frameIndex, FaceResult &result) const {
+    std::unique_lock<std::mutex> guard(outLock_);
+    while (!hasResult_ || result_.frameIndex < frameIndex) {
+        outReady_.wait(guard);
+    }
+    result = result_;
+    return true;
+}
+
+void AsyncFaceDetector::reset() {
+    std::lock_guard<std::mutex> in(inLock_);
+    std::lock_guard<std::mutex> out(outLock_);
+    hasPending_ = false;
+    resetTracks_ = true;
+    hasResult_ = false;
+    generation_++;
+}
+
+void AsyncFaceDetector::run() {
+    cv::Mat small, grey;
+    std::vector<cv::Rect> faces;
+
+    for (;;) {
+        long long index, generation;
+        double submitted;
+        bool resetTracks;
+        {
+            std::unique_lock<std::mutex> guard(inLock_);
+            while (!hasPending_ && !stop_) {
+                inReady_.wait(guard);
+            }
+            if (stop_) {
+                // this thread's cascade would otherwise stay in the pool
+                guard.unlock();
+                tracker_.detectors().release();
+                return;
+            }
+            // take the newest frame, the submitter gets the old buffer back
+            cv::swap(small, pending_);
+            index = pendingIndex_;
+            submitted = pendingTime_;
+            hasPending_ = false;
+            resetTracks = resetTracks_;
+            resetTracks_ = false;
+            // reset() changes it under inLock_ as well, so this is stable here
+            generation = generation_;
+        }
+
+        {
+            PROFILE_SCOPE("faceDetect");
+            if (resetTracks) {
+                tracker_.reset();
+            }
+            cv::cvtColor(small, grey, cv::COLOR_BGR2GRAY);
+            tracker_.update(grey, faces);
+        }
+
+        // back to the coordinates of the submitted frame
+        for (size_t i = 0; i < faces.size(); i++) {
+            faces[i].x = cvRound(faces[i].x / scale_);
+            faces[i].y = cvRound(faces[i].y / scale_);
+            faces[i].width = cvRound(faces[i].width / scale_);
+            faces[i].height = cvRound(faces[i].height / scale_);
+        }
+
+        std::lock_guard<std::mutex> guard(outLock_);
+        if (generation != generation_) {
+            continue;
+        }
+        result_.faces.swap(faces);
+        result_.frameIndex = index;
+        result_.timestamp = submitted;
+        result_.latencyMs = (now() - submitted) * 1000.0;
+        if (profilingEnabled()) {
+            static StageHistogram &latency = profileStage("face latency");
+            latency.record(result_.latencyMs);
+        }
+        hasResult_ = true;
+        outReady_.notify_all();
+    }
+}
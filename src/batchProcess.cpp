@@ -0,0 +1,341 @@
+/**
+ * @file batchProcess.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief headless batch mode: run a filter chain over video files and images
+ * @version 0.1
+ * @date 2024-02-18
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "parallel.h"
+#include "pipeline.h"
+#include "framePool.h"
+#include "profiler.h"
+#include "recorder.h"
+
+static void usage(const char *prog) {
+    printf("Usage: %s -i <video | image glob | directory> [-i ...] -p <filter spec>\n", prog);
+    printf("          [-o <output directory>] [-j <parallel files>] [-t <threads per filter>]\n");
+    printf("          [-P <stage timings .csv | .json>] [-c <mjpg | h264 | ffv1>]\n");
+    printf("  e.g. %s -i 'frames/*.jpg' -i clip.mp4 -p \"sepia|blur\" -o out -j 8\n", prog);
+    printf("  filter stages:");
+    std::vector<std::string> names = FilterPipeline::stageNames();
+    for (size_t i = 0; i < names.size(); i++) {
+        printf(" %s", names[i].c_str());
+    }
+    printf("\n");
+}
+
+static double now() {
+    return cv::getTickCount() / cv::getTickFrequency();
+}
+
+static std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+static std::string extension(const std::string &path) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return "";
+    }
+    return lower(path.substr(dot + 1));
+}
+
+static std::string baseName(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static bool isVideo(const std::string &path) {
+    const char *exts[] = {"avi", "mp4", "mov", "mkv", "m4v", "mpg", "mpeg", "webm", "wmv"};
+    std::string ext = extension(path);
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        if (ext == exts[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isImage(const std::string &path) {
+    const char *exts[] = {"jpg", "jpeg", "png", "bmp", "tif", "tiff", "webp", "ppm", "pgm"};
+    std::string ext = extension(path);
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        if (ext == exts[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// expand one -i argument into the files it names
+static void expandInput(const std::string &arg, std::vector<std::string> &files) {
+    struct stat st;
+    if (stat(arg.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        files.push_back(arg);
+        return;
+    }
+
+    // a directory means every image and video in it
+    std::string pattern = arg;
+    bool dir = stat(arg.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    if (dir) {
+        pattern = arg + "/*";
+    }
+    std::vector<cv::String> found;
+    cv::glob(pattern, found, false);
+    for (size_t i = 0; i < found.size(); i++) {
+        if (isImage(found[i]) || isVideo(found[i])) {
+            files.push_back(found[i]);
+        }
+    }
+}
+
+// the name a file's result gets in the output directory: videos become
+// <name>_out.avi (.mp4, .mkv), images keep their name
+static std::string outputName(const std::string &path, RecordCodec codec) {
+    std::string name = baseName(path);
+    if (isVideo(path)) {
+        return name.substr(0, name.find_last_of('.')) + "_out." + recordExtension(codec);
+    }
+    return name;
+}
+
+// Output paths, one per file. Inputs from different directories can share a
+// name, so a name that is already taken gets a _2, _3, ... suffix; no two
+// workers ever write the same file. Returns false if an output would
+// overwrite one of the inputs (e.g. -o names the input directory).
+static bool outputPaths(const std::vector<std::string> &files, const std::string &outDir, RecordCodec codec,
+                        std::vector<std::string> &outputs) {
+    std::set<std::pair<dev_t, ino_t> > inputs;
+    struct stat st;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (stat(files[i].c_str(), &st) == 0) {
+            inputs.insert(std::make_pair(st.st_dev, st.st_ino));
+        }
+    }
+
+    std::set<std::string> taken;
+    outputs.clear();
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string name = outputName(files[i], codec);
+        size_t dot = name.find_last_of('.');
+        std::string stem = name.substr(0, dot), ext = dot == std::string::npos ? "" : name.substr(dot);
+        for (int n = 2; !taken.insert(name).second; n++) {
+            name = stem + "_" + std::to_string(n) + ext;
+        }
+        std::string path = outDir + "/" + name;
+        // stat follows "..", symlinks and hard links to the file itself
+        if (stat(path.c_str(), &st) == 0 && inputs.count(std::make_pair(st.st_dev, st.st_ino))) {
+            printf("Refusing to overwrite input %s with %s\n", files[i].c_str(), path.c_str());
+            return false;
+        }
+        outputs.push_back(path);
+    }
+    return true;
+}
+
+// counters shared by the workers
+struct BatchStats {
+    std::atomic<long long> frames{0};
+    std::atomic<int> failed{0};
+    std::mutex printLock;
+};
+
+// run the chain over every frame of a video, writing it to outPath
+static bool processVideo(const std::string &path, const std::string &outPath, RecordCodec codec,
+                         FilterPipeline &pipeline, BatchStats &stats) {
+    cv::VideoCapture cap(path);
+    if (!cap.isOpened()) {
+        return false;
+    }
+    double fps = cap.get(cv::CAP_PROP_FPS);
+    if (fps <= 0) {
+        fps = 30.0;
+    }
+
+    cv::VideoWriter writer;
+    FrameContext context;
+    context.realtime = false;
+    cv::Mat frame, result;
+
+    for (;;) {
+        {
+            PROFILE_SCOPE("decode");
+            if (!cap.read(frame) || frame.empty()) {
+                break;
+            }
+        }
+        // capture time, as from a camera: async detection measures its latency
+        // from it. The position in the video is frameIndex.
+        context.timestamp = now();
+        if (pipeline.process(frame, result, context) != 0) {
+            return false;
+        }
+        // the writer is opened on the first result so it gets the real size
+        // and channel count (e.g. one channel after "gray")
+        if (!writer.isOpened() &&
+            !openVideoWriter(writer, outPath, codec, fps, result.size(), result.channels() == 3)) {
+            return false;
+        }
+        {
+            PROFILE_SCOPE("encode");
+            writer.write(result);
+        }
+        context.frameIndex++;
+        stats.frames++;
+    }
+    return true;
+}
+
+static bool processImage(const std::string &path, const std::string &outPath,
+                         FilterPipeline &pipeline, BatchStats &stats) {
+    cv::Mat image;
+    {
+        PROFILE_SCOPE("decode");
+        image = cv::imread(path);
+    }
+    if (image.empty()) {
+        return false;
+    }
+    FrameContext context;
+    context.realtime = false;
+    context.timestamp = now();
+    cv::Mat result;
+    if (pipeline.process(image, result, context) != 0) {
+        return false;
+    }
+    PROFILE_SCOPE("encode");
+    if (!cv::imwrite(outPath, result)) {
+        return false;
+    }
+    stats.frames++;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    // frames of the same size reuse pooled buffers instead of the heap
+    installFramePool();
+    std::vector<std::string> inputs;
+    std::string spec, outDir = "batch_output", profilePath;
+    int jobs = 0, filterThreads = -1;
+    RecordCodec codec = RECORD_MJPG;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "-i") {
+            inputs.push_back(argv[++i]);
+        } else if (i + 1 < argc && arg == "-p") {
+            spec = argv[++i];
+        } else if (i + 1 < argc && arg == "-o") {
+            outDir = argv[++i];
+        } else if (i + 1 < argc && arg == "-j") {
+            jobs = atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "-t") {
+            filterThreads = atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "-c" && parseRecordCodec(argv[i + 1], codec)) {
+            i++;
+        } else if (i + 1 < argc && arg == "-P") {
+            profilePath = argv[++i];
+            setProfiling(true);
+        } else {
+            usage(argv[0]);
+            return(-1);
+        }
+    }
+    if (inputs.empty()) {
+        usage(argv[0]);
+        return(-1);
+    }
+
+    // check the spec once before starting any worker
+    FilterPipeline check;
+    std::string specError;
+    if (!check.parse(spec, &specError)) {
+        printf("Bad filter chain: %s\n", specError.c_str());
+        return(-1);
+    }
+
+    std::vector<std::string> files;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        expandInput(inputs[i], files);
+    }
+    if (files.empty()) {
+        printf("No input files found\n");
+        return(-1);
+    }
+
+    if (mkdir(outDir.c_str(), 0755) != 0 && errno != EEXIST) {
+        printf("Unable to create output directory %s\n", outDir.c_str());
+        return(-1);
+    }
+    std::vector<std::string> outputs;
+    if (!outputPaths(files, outDir, codec, outputs)) {
+        return(-1);
+    }
+
+    // parallelism goes across files first; the filters get the cores that are left
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    if (jobs <= 0) {
+        jobs = cores;
+    }
+    // no limit for chains that detect faces (face, colorfulFaces or any
+    // detect=1 stage): every worker and detector thread has its own cascade
+    jobs = std::min(jobs, (int)files.size());
+    setFilterThreads(filterThreads >= 0 ? filterThreads : std::max(1, cores / jobs));
+
+    BatchStats stats;
+    std::atomic<size_t> nextFile{0};
+    double start = now();
+
+    std::vector<std::thread> workers;
+    for (int w = 0; w < jobs; w++) {
+        workers.push_back(std::thread([&]() {
+            // each worker owns its pipeline and buffers
+            FilterPipeline pipeline;
+            pipeline.parse(spec);
+            for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+                // nothing of the last file, such as its face tracks, may leak into this one
+                pipeline.reset();
+                bool ok = isVideo(files[i]) ? processVideo(files[i], outputs[i], codec, pipeline, stats)
+                                            : processImage(files[i], outputs[i], pipeline, stats);
+                if (!ok) {
+                    stats.failed++;
+                    std::lock_guard<std::mutex> guard(stats.printLock);
+                    printf("Failed to process %s\n", files[i].c_str());
+                }
+            }
+        }));
+    }
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w].join();
+    }
+
+    double seconds = now() - start;
+    long long frames = stats.frames;
+    printf("Processed %lld frames from %d files (%d failed) in %.2f s: %.1f frames per second\n",
+           frames, (int)files.size(), (int)stats.failed, seconds, seconds > 0 ? frames / seconds : 0.0);
+    printPoolStats(framePool()->stats());
+    if (!profilePath.empty() && writeProfile(profilePath) != 0) {
+        printf("Unable to write %s\n", profilePath.c_str());
+    }
+    printf("Output written to %s\n", outDir.c_str());
+
+    return stats.failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,388 @@
+/**
+ * @file benchFilters.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief benchmark for every filter in filter.h and detectFaces, JSON output
+ * @version 0.1
+ * @date 2024-02-20
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "filter.h"
+#include "faceDetect.h"
+#include "faceDetector.h"
+#include "parallel.h"
+#include "framePool.h"
+#include "profiler.h"
+#include "roiFilter.h"
+#include "kernels.h"
+#include "blurKernel.h"
+
+// one filter under test; src is the input at the current resolution
+struct BenchCase {
+    std::string name;
+    std::function<void(cv::Mat &src, cv::Mat &dst)> run;
+};
+
+struct BenchResult {
+    std::string name;
+    cv::Size size;
+    int reps;
+    double medianMs, p95Ms, mpixPerSec;
+    long long heapAllocs; // during the timed runs, -1 without -a
+};
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-i image] [-n repetitions] [-w warmup runs] [-t threads]\n", prog);
+    printf("          [-r WxH[,WxH...]] [-f filter[,filter...]] [-o results.json] [-a] [-v [-d dir]]\n");
+    printf("  -a: allocate Mats from the frame pool and count heap allocations\n");
+    printf("  -P file: also write the filters' own stage timers (.csv or .json)\n");
+    printf("  -v: check every SIMD variant against the scalar kernels bit for bit and the parallel\n");
+    printf("      face detector against the serial one on the images in -d (default data), then exit\n");
+    printf("  set FILTER_ISA=scalar|sse4.1|avx2|avx512 to time a specific variant\n");
+    printf("  default resolutions: 640x480,1280x720,1920x1080,3840x2160\n");
+}
+
+// value at fraction q of the sorted samples (nearest rank)
+static double percentile(const std::vector<double> &sorted, double q) {
+    size_t idx = (size_t)std::min((double)sorted.size() - 1, std::ceil(q * sorted.size()) - 1);
+    return sorted[idx];
+}
+
+// s as the body of a JSON string: quotes, backslashes and control characters escaped
+static std::string jsonEscape(const std::string &s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else {
+            out += (char)c;
+        }
+    }
+    return out;
+}
+
+static std::vector<std::string> split(const std::string &s, char sep) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(sep, start);
+        if (end == std::string::npos) {
+            end = s.size();
+        }
+        if (end > start) {
+            parts.push_back(s.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return parts;
+}
+
+// Self-test: every kernel variant against the scalar one on random rows,
+// then the filters built on them on a random frame. Returns the mismatches.
+static int verifyVariants() {
+    int failures = verifyFilterKernels(true);
+
+    cv::Mat src(720, 1280, CV_8UC3);
+    cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(256));
+    std::vector<const FilterKernels *> variants = availableFilterKernels();
+    std::vector<cv::Mat> reference;
+    for (size_t v = 0; v < variants.size(); v++) {
+        selectFilterKernels(variants[v]->isa);
+        std::vector<cv::Mat> out(3);
+        blur5x5_2(src, out[0]);
+        gradientFused(src, &out[1], NULL);
+        cartoon(src, out[2], 15, 20);
+        if (v == 0) {
+            reference = out;
+            continue;
+        }
+        int bad = 0;
+        for (size_t k = 0; k < out.size(); k++) {
+            bad += cv::norm(out[k], reference[k], cv::NORM_INF) != 0;
+        }
+        printf("%-8s filters %s\n", variants[v]->isa, bad ? "MISMATCH" : "ok");
+        failures += bad;
+    }
+    printf(failures ? "FAIL\n" : "PASS\n");
+    return failures;
+}
+
+static double boxIoU(const cv::Rect &a, const cv::Rect &b) {
+    double inter = (a & b).area();
+    double uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0.0;
+}
+
+// faces of found that some face of other overlaps by at least half (IoU)
+static int matchedFaces(const std::vector<cv::Rect> &found, const std::vector<cv::Rect> &other) {
+    int matched = 0;
+    for (size_t i = 0; i < found.size(); i++) {
+        for (size_t j = 0; j < other.size(); j++) {
+            if (boxIoU(found[i], other[j]) >= 0.5) {
+                matched++;
+                break;
+            }
+        }
+    }
+    return matched;
+}
+
+// Recall check of the parallel face detector: on every .jpg / .jpeg in dir,
+// the faces the serial detector finds that the parallel one finds as well.
+// Fails below 95% overall; without a cascade there is nothing to compare.
+static int verifyFaceRecall(const std::string &dir) {
+    FaceDetector *serial = defaultFaceDetectors().local();
+    if (!serial) {
+        printf("faces    skipped, %s does not load\n", defaultFaceModel().c_str());
+        return 0;
+    }
+    FaceDetectorParams params;
+    params.parallel = true;
+    FaceDetectorPool parallel(params);
+
+    std::vector<cv::String> files, jpeg;
+    cv::glob(dir + "/*.jpg", files);
+    cv::glob(dir + "/*.jpeg", jpeg);
+    files.insert(files.end(), jpeg.begin(), jpeg.end());
+
+    int serialFaces = 0, parallelFaces = 0, kept = 0;
+    cv::Mat grey;
+    std::vector<cv::Rect> a, b;
+    for (size_t i = 0; i < files.size(); i++) {
+        cv::Mat image = cv::imread(files[i]);
+        if (image.empty()) {
+            continue;
+        }
+        cv::cvtColor(image, grey, cv::COLOR_BGR2GRAY);
+        serial->detect(grey, a);
+        parallel.detect(grey, b);
+        int matched = matchedFaces(a, b);
+        printf("faces    %-40s serial %2d  parallel %2d  matched %2d\n", files[i].c_str(), (int)a.size(),
+               (int)b.size(), matched);
+        serialFaces += (int)a.size();
+        parallelFaces += (int)b.size();
+        kept += matched;
+    }
+    double recall = serialFaces > 0 ? (double)kept / serialFaces : 1.0;
+    printf("faces    %d images, serial %d, parallel %d, recall %.1f%%\n", (int)files.size(), serialFaces,
+           parallelFaces, recall * 100.0);
+    bool ok = !files.empty() && recall >= 0.95;
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    std::string imagePath, outPath, filterList, profilePath, faceDir = "data";
+    int reps = 50, warmup = 5;
+    bool pool = false, verify = false;
+    std::vector<cv::Size> sizes;
+    sizes.push_back(cv::Size(640, 480));
+    sizes.push_back(cv::Size(1280, 720));
+    sizes.push_back(cv::Size(1920, 1080));
+    sizes.push_back(cv::Size(3840, 2160));
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "-i") {
+            imagePath = argv[++i];
+        } else if (i + 1 < argc && arg == "-n") {
+            reps = std::max(1, atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "-w") {
+            warmup = std::max(0, atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "-t") {
+            setFilterThreads(atoi(argv[++i]));
+        } else if (i + 1 < argc && arg == "-r") {
+            sizes.clear();
+            std::vector<std::string> list = split(argv[++i], ',');
+            for (size_t k = 0; k < list.size(); k++) {
+                int w = 0, h = 0;
+                if (sscanf(list[k].c_str(), "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+                    sizes.push_back(cv::Size(w, h));
+                }
+            }
+        } else if (i + 1 < argc && arg == "-f") {
+            filterList = argv[++i];
+        } else if (i + 1 < argc && arg == "-o") {
+            outPath = argv[++i];
+        } else if (i + 1 < argc && arg == "-P") {
+            profilePath = argv[++i];
+            setProfiling(true);
+        } else if (i + 1 < argc && arg == "-d") {
+            faceDir = argv[++i];
+        } else if (arg == "-v") {
+            verify = true;
+        } else if (arg == "-a") {
+            pool = true;
+        } else {
+            usage(argv[0]);
+            return(-1);
+        }
+    }
+
+    if (verify) {
+        int failures = verifyVariants();
+        failures += verifyFaceRecall(faceDir);
+        return failures == 0 ? 0 : 1;
+    }
+
+    if (pool) {
+        installFramePool();
+    }
+
+    // the source: an image if given, otherwise uniform noise
+    cv::Mat base;
+    if (!imagePath.empty()) {
+        base = cv::imread(imagePath);
+        if (base.empty()) {
+            printf("Unable to read image %s\n", imagePath.c_str());
+            return(-1);
+        }
+    }
+
+    // scratch images some cases need, refreshed for each resolution
+    cv::Mat sobelX, sobelY, grey;
+    std::vector<cv::Rect> faces, found;
+    // the default cascade settings, with the scales and tiles spread over the filter threads
+    FaceDetectorParams parallelParams;
+    parallelParams.parallel = true;
+    FaceDetectorPool parallelFaces(parallelParams);
+    // filters limited to the face rectangle or to everything around it
+    RoiParams insideParams, outsideParams;
+    outsideParams.mode = ROI_OUTSIDE;
+    RoiFilter inside(insideParams), outside(outsideParams);
+
+    std::vector<BenchCase> cases;
+    cases.push_back(BenchCase{"greyscale", [](cv::Mat &s, cv::Mat &d) { greyscale(s, d); }});
+    cases.push_back(BenchCase{"sepiaTone", [](cv::Mat &s, cv::Mat &d) { sepiaTone(s, d); }});
+    cases.push_back(BenchCase{"blur5x5_1", [](cv::Mat &s, cv::Mat &d) { blur5x5_1(s, d); }});
+    cases.push_back(BenchCase{"blur5x5_2", [](cv::Mat &s, cv::Mat &d) { blur5x5_2(s, d); }});
+    cases.push_back(BenchCase{"sobelX3x3", [](cv::Mat &s, cv::Mat &d) { sobelX3x3(s, d); }});
+    cases.push_back(BenchCase{"sobelY3x3", [](cv::Mat &s, cv::Mat &d) { sobelY3x3(s, d); }});
+    cases.push_back(BenchCase{"magnitude", [&](cv::Mat &, cv::Mat &d) { magnitude(sobelX, sobelY, d); }});
+    cases.push_back(BenchCase{"gradientFused", [](cv::Mat &s, cv::Mat &d) { gradientFused(s, &d, NULL); }});
+    cases.push_back(BenchCase{"blurQuantize", [](cv::Mat &s, cv::Mat &d) { blurQuantize(s, d, 10); }});
+    cases.push_back(BenchCase{"negativeFilter", [](cv::Mat &s, cv::Mat &d) { negativeFilter(s, d); }});
+    cases.push_back(BenchCase{"embossEffect", [](cv::Mat &s, cv::Mat &d) { embossEffect(s, d); }});
+    cases.push_back(BenchCase{"colorfulFaces", [&](cv::Mat &s, cv::Mat &d) { colorfulFaces(s, faces, d); }});
+    cases.push_back(BenchCase{"cartoon", [](cv::Mat &s, cv::Mat &d) { cartoon(s, d, 15, 20); }});
+    cases.push_back(BenchCase{"warpImage", [](cv::Mat &s, cv::Mat &d) { warpImage(s, d, true); }});
+    cases.push_back(BenchCase{"blur5x5_2/faces", [&](cv::Mat &s, cv::Mat &d) {
+        inside.apply(s, d, faces, [](cv::Mat &a, cv::Mat &b) { return blur5x5_2(a, b); });
+    }});
+    cases.push_back(BenchCase{"cartoon/background", [&](cv::Mat &s, cv::Mat &d) {
+        outside.apply(s, d, faces, [](cv::Mat &a, cv::Mat &b) { return cartoon(a, b, 15, 20); });
+    }});
+    // the luminance-only paths, on the single-channel grey image
+    cases.push_back(BenchCase{"greyscale/1ch", [](cv::Mat &s, cv::Mat &d) { greyscale(s, d, 1); }});
+    cases.push_back(BenchCase{"blur5x5_2/1ch", [&](cv::Mat &, cv::Mat &d) { blur5x5_2(grey, d); }});
+    cases.push_back(BenchCase{"gradientFused/1ch", [&](cv::Mat &, cv::Mat &d) { gradientFused(grey, &d, NULL); }});
+    // without a cascade detectFaces returns at once, which would time nothing
+    if (defaultFaceDetectors().local()) {
+        cases.push_back(BenchCase{"detectFaces", [&](cv::Mat &, cv::Mat &) { detectFaces(grey, found); }});
+        cases.push_back(BenchCase{"detectFaces/parallel", [&](cv::Mat &, cv::Mat &) { parallelFaces.detect(grey, found); }});
+    } else {
+        fprintf(stderr, "Skipping detectFaces: %s does not load\n", defaultFaceModel().c_str());
+    }
+
+    std::vector<std::string> only = split(filterList, ',');
+    std::vector<BenchResult> results;
+
+    for (size_t si = 0; si < sizes.size(); si++) {
+        cv::Size size = sizes[si];
+        cv::Mat src(size, CV_8UC3), dst;
+        if (base.empty()) {
+            cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(256));
+        } else {
+            cv::resize(base, src, size, 0, 0, cv::INTER_AREA);
+        }
+        sobelX3x3(src, sobelX);
+        sobelY3x3(src, sobelY);
+        cv::cvtColor(src, grey, cv::COLOR_BGR2GRAY);
+        faces.clear();
+        faces.push_back(cv::Rect(size.width / 4, size.height / 4, size.width / 4, size.height / 3));
+
+        for (size_t ci = 0; ci < cases.size(); ci++) {
+            BenchCase &bc = cases[ci];
+            if (!only.empty() && std::find(only.begin(), only.end(), bc.name) == only.end()) {
+                continue;
+            }
+
+            // warm-up: caches, page faults and lazily created buffers
+            for (int k = 0; k < warmup; k++) {
+                bc.run(src, dst);
+            }
+
+            std::vector<double> samples(reps);
+            long long heapBefore = pool ? framePool()->stats().heapAllocs : 0;
+            for (int k = 0; k < reps; k++) {
+                std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+                bc.run(src, dst);
+                std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+                samples[k] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            }
+            long long heapAllocs = pool ? framePool()->stats().heapAllocs - heapBefore : -1;
+            std::sort(samples.begin(), samples.end());
+
+            BenchResult r;
+            r.name = bc.name;
+            r.size = size;
+            r.reps = reps;
+            r.medianMs = percentile(samples, 0.5);
+            r.p95Ms = percentile(samples, 0.95);
+            r.heapAllocs = heapAllocs;
+            r.mpixPerSec = r.medianMs > 0 ? (double)size.area() / 1e6 / (r.medianMs / 1000.0) : 0.0;
+            results.push_back(r);
+
+            fprintf(stderr, "%-15s %5dx%-5d median %9.3f ms  p95 %9.3f ms  %9.1f MPix/s",
+                    r.name.c_str(), size.width, size.height, r.medianMs, r.p95Ms, r.mpixPerSec);
+            if (pool) {
+                fprintf(stderr, "  %lld heap allocs", r.heapAllocs);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+
+    // JSON to stdout, or to the file given with -o
+    FILE *out = stdout;
+    if (!outPath.empty()) {
+        out = fopen(outPath.c_str(), "w");
+        if (!out) {
+            printf("Unable to write %s\n", outPath.c_str());
+            return(-1);
+        }
+    }
+    fprintf(out, "{\n  \"threads\": %d,\n  \"warmup\": %d,\n  \"isa\": \"%s\",\n  \"source\": \"%s\",\n  \"results\": [\n",
+            getFilterThreads(), warmup, blurKernelISA(), imagePath.empty() ? "noise" : jsonEscape(imagePath).c_str());
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        fprintf(out, "    {\"filter\": \"%s\", \"width\": %d, \"height\": %d, \"reps\": %d, "
+                     "\"median_ms\": %.4f, \"p95_ms\": %.4f, \"mpix_per_s\": %.2f, \"heap_allocs\": %lld}%s\n",
+                r.name.c_str(), r.size.width, r.size.height, r.reps, r.medianMs, r.p95Ms,
+                r.mpixPerSec, r.heapAllocs, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+    if (!profilePath.empty() && writeProfile(profilePath) != 0) {
+        printf("Unable to write %s\n", profilePath.c_str());
+        return(-1);
+    }
+
+    return(0);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file blurKernel.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row kernels for the separable [1 2 4 2 1] Gaussian blur
+ * @version 0.1
+ * @date 2024-02-10
+*/
+
+#include "blurKernel.h"
+#include "kernels.h"
+
+// Both passes reduce to the same 5-tap weighted sum of five byte streams,
+// done by the SIMD variant picked for this CPU in kernels.cpp.
+
+void blur5RowH(const unsigned char *src, unsigned char *dst, int cols, int cn) {
+    int lo = 2 * cn;
+    int n = (cols - 4) * cn;
+    if (n <= 0) {
+        return;
+    }
+    filterKernels().weightedSum5(src, src + cn, src + 2 * cn, src + 3 * cn, src + 4 * cn, dst + lo, n);
+}
+
+void blur5RowV(const unsigned char *r0, const unsigned char *r1, const unsigned char *r2,
+               const unsigned char *r3, const unsigned char *r4,
+               unsigned char *dst, int cols, int cn) {
+    int lo = 2 * cn;
+    int n = (cols - 4) * cn;
+    if (n <= 0) {
+        return;
+    }
+    filterKernels().weightedSum5(r0 + lo, r1 + lo, r2 + lo, r3 + lo, r4 + lo, dst + lo, n);
+}
+
+const char *blurKernelISA() {
+    return filterKernels().isa;
+}
@@ -12,6 +12,7 @@
 #include <cstdlib>
 #include <opencv2/opencv.hpp>
 #include "faceDetect.h"
+#include "faceDetector.h"
 
 
 /*
@@ -20,45 +21,32 @@
   std::vector<cv::Rect> &faces - a standard vector of cv::Rect rectangles indicating where faces were found
      if the length of the vector is zero, no faces were found
  */
+// Both run on the calling thread's detector from defaultFaceDetectors(), so
+// any number of threads can detect at once; each thread loads the cascade
+// on its first call. The model is FACE_CASCADE_FILE unless the FACE_CASCADE
+// environment variable names another; if it cannot be loaded they return -1.
 int detectFaces( cv::Mat &grey, std::vector<cv::Rect> &faces ) {
-  // a static variable to hold a half-size image
-  static cv::Mat half;
-  
-  // a static variable to hold the classifier
-  static cv::CascadeClassifier face_cascade;
-
-  // the path to the haar cascade file
-  static cv::String face_cascade_file(FACE_CASCADE_FILE);
-
-  if( face_cascade.empty() ) {
-    if( !face_cascade.load( face_cascade_file ) ) {
-      printf("Unable to load face cascade file\n");
-      printf("Terminating\n");
-      exit(-1);
-    }
-  }
-
-  // clear the vector of faces
-  faces.clear();
-  
-  // cut the image size in half to reduce processing time
-  cv::resize( grey, half, cv::Size(grey.cols/2, grey.rows/2) );
-
-  // equalize the image
-  cv::equalizeHist( half, half );
+  // search a half-size, equalized copy and scale the rectangles back up
+  return defaultFaceDetectors().detect( grey, faces );
+}
 
-  // apply the Haar cascade detector
-  face_cascade.detectMultiScale( half, faces );
+/*
+  Arguments:
+  cv::Mat grey  - a greyscale source image
+  cv::Rect region - the part of grey to search, e.g. around a face found in the last frame
+  std::vector<cv::Rect> &faces - faces found inside region, in grey's coordinates
+  int minSize - smallest face width to look for, 0 for no limit
 
-  // adjust the rectangle sizes back to the full size image
-  for(int i=0;i<faces.size();i++) {
-    faces[i].x *= 2;
-    faces[i].y *= 2;
-    faces[i].width *= 2;
-    faces[i].height *= 2;
+  Searches only the region at full resolution, which is much cheaper than a
+  full detectFaces pass when the region is small.
+ */
+int detectFacesInRegion( cv::Mat &grey, cv::Rect region, std::vector<cv::Rect> &faces, int minSize ) {
+  FaceDetector *detector = defaultFaceDetectors().local();
+  if( !detector ) {
+    faces.clear();
+    return(-1);
   }
-
-  return(0);
+  return detector->detectInRegion( grey, region, faces, minSize );
 }
 
 /* Draws rectangles into frame given a vector of rectangles
@@ -0,0 +1,297 @@
+/**
+ * @file faceDetector.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief reentrant Haar cascade face detector and a per-thread pool of them
+ * @version 0.1
+ * @date 2024-03-11
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include "faceDetect.h"
+#include "faceDetector.h"
+#include "parallel.h"
+#include "profiler.h"
+
+// detectMultiScale's grouping: rectangles within 20% of each other are one face
+static const double kGroupEps = 0.2;
+
+std::string defaultFaceModel() {
+    const char *path = getenv("FACE_CASCADE");
+    return path && *path ? path : FACE_CASCADE_FILE;
+}
+
+FaceDetector::FaceDetector(const FaceDetectorParams &params) : params_(params) {
+    if (params_.model.empty()) {
+        params_.model = defaultFaceModel();
+    }
+    params_.downscale = std::min(1.0, std::max(0.05, params_.downscale));
+}
+
+bool FaceDetector::load(std::string *error) {
+    if (!cascade_.load(params_.model)) {
+        if (error) {
+            *error = "unable to load face cascade " + params_.model;
+        }
+        return false;
+    }
+    return true;
+}
+
+// the image detect() searches: grey reduced by downscale and equalized
+static const cv::Mat &searchImage(const cv::Mat &grey, const FaceDetectorParams &params, cv::Mat &small) {
+    const double d = params.downscale;
+    const cv::Mat *search = &grey;
+    if (d < 1.0) {
+        cv::resize(grey, small, cv::Size((int)(grey.cols * d), (int)(grey.rows * d)));
+        search = &small;
+    }
+    if (params.equalize) {
+        cv::equalizeHist(*search, small);
+        search = &small;
+    }
+    return *search;
+}
+
+// boxes found in the search image, back to the size of grey
+static void toGrey(std::vector<cv::Rect> &faces, double d) {
+    for (size_t i = 0; i < faces.size(); i++) {
+        faces[i].x = cvRound(faces[i].x / d);
+        faces[i].y = cvRound(faces[i].y / d);
+        faces[i].width = cvRound(faces[i].width / d);
+        faces[i].height = cvRound(faces[i].height / d);
+    }
+}
+
+int FaceDetector::detect(const cv::Mat &grey, std::vector<cv::Rect> &faces) {
+    faces.clear();
+    if (!loaded() || grey.empty()) {
+        return -1;
+    }
+
+    // search a reduced copy to save time; the limits shrink with it
+    const double d = params_.downscale;
+    const cv::Mat &search = searchImage(grey, params_, small_);
+    cv::Size minSize(cvRound(params_.minSize.width * d), cvRound(params_.minSize.height * d));
+    cv::Size maxSize(cvRound(params_.maxSize.width * d), cvRound(params_.maxSize.height * d));
+    cascade_.detectMultiScale(search, faces, params_.scaleFactor, params_.minNeighbors, 0, minSize, maxSize);
+    toGrey(faces, d);
+    return 0;
+}
+
+int FaceDetector::detectParallel(const cv::Mat &grey, std::vector<cv::Rect> &faces, FaceDetectorPool &workers) {
+    faces.clear();
+    if (!loaded() || grey.empty()) {
+        return -1;
+    }
+    const double d = params_.downscale;
+    const cv::Mat &search = searchImage(grey, params_, small_);
+    const cv::Size base = cascade_.getOriginalWindowSize();
+    cv::Size minSize(cvRound(params_.minSize.width * d), cvRound(params_.minSize.height * d));
+    cv::Size maxSize(cvRound(params_.maxSize.width * d), cvRound(params_.maxSize.height * d));
+    if (maxSize.area() == 0) {
+        maxSize = search.size();
+    }
+
+    // The scales in the order detectMultiScale walks them. Each tile searches
+    // one window size: with minSize = maxSize = that window, detectMultiScale
+    // skips the smaller scales without work and stops after this one. Every
+    // window whose top left corner is in a tile's core fits inside the tile,
+    // so each position is searched by exactly one tile and no hit is counted
+    // twice.
+    //
+    // The hits are close to the serial ones but not identical: every tile is
+    // shrunk by the scale on its own, so its pixels are interpolated with a
+    // different phase than the whole image, and its scan grid (2 pixels of
+    // the shrunk image, 1 past factor 2) starts at the tile corner. The core
+    // edges sit on multiples of that step, which keeps the grid of every tile
+    // in line with the serial one up to rounding. bench_YZ -v compares the
+    // two on the sample images.
+    const int threads = std::max(1, getFilterThreads());
+    tiles_.clear();
+    cv::Size last;
+    for (double factor = 1.0;; factor *= params_.scaleFactor) {
+        cv::Size window(cvRound(base.width * factor), cvRound(base.height * factor));
+        if (window.width > maxSize.width || window.height > maxSize.height ||
+            window.width > search.cols || window.height > search.rows) {
+            break;
+        }
+        if (window.width < minSize.width || window.height < minSize.height || window == last) {
+            continue;
+        }
+        last = window;
+
+        // cores about four windows wide, at most twice as many tiles as threads;
+        // the large windows of the coarse scales end up in a single tile
+        int nx = std::max(1, std::min(search.cols / (4 * window.width), threads));
+        int ny = std::max(1, std::min(search.rows / (4 * window.height), threads));
+        while (nx * ny > 2 * threads) {
+            (nx > ny ? nx : ny)--;
+        }
+        // the scan step of this scale in search image pixels
+        const double stride = (factor > 2.0 ? 1.0 : 2.0) * factor;
+        auto edge = [stride](int total, int k, int n) {
+            return k == n ? total : (int)(std::floor(total * k / n / stride) * stride);
+        };
+        for (int ty = 0; ty < ny; ty++) {
+            for (int tx = 0; tx < nx; tx++) {
+                int x0 = edge(search.cols, tx, nx), x1 = edge(search.cols, tx + 1, nx);
+                int y0 = edge(search.rows, ty, ny), y1 = edge(search.rows, ty + 1, ny);
+                Tile tile;
+                tile.core = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+                tile.area = cv::Rect(x0, y0, x1 - x0 + window.width, y1 - y0 + window.height) &
+                            cv::Rect(0, 0, search.cols, search.rows);
+                tile.window = window;
+                if (tile.core.area() > 0 && tile.area.width >= window.width && tile.area.height >= window.height) {
+                    tiles_.push_back(tile);
+                }
+            }
+        }
+    }
+
+    hits_.resize(tiles_.size());
+    {
+        PROFILE_SCOPE("faceDetect tiles");
+        // fine-grained bands, the tiles of the fine scales cost the most
+        parallelRows(0, (int)tiles_.size(), [&](int t0, int t1) {
+            FaceDetector *detector = workers.local();
+            for (int t = t0; t < t1; t++) {
+                std::vector<cv::Rect> &hits = hits_[t];
+                hits.clear();
+                if (!detector) {
+                    continue;
+                }
+                const Tile &tile = tiles_[t];
+                detector->cascade_.detectMultiScale(search(tile.area), hits, params_.scaleFactor, 0, 0,
+                                                    tile.window, tile.window);
+                size_t kept = 0;
+                for (size_t i = 0; i < hits.size(); i++) {
+                    cv::Rect r = hits[i] + tile.area.tl();
+                    if (tile.core.contains(r.tl())) {
+                        hits[kept++] = r;
+                    }
+                }
+                hits.resize(kept);
+            }
+        }, 1);
+    }
+
+    for (size_t t = 0; t < hits_.size(); t++) {
+        faces.insert(faces.end(), hits_[t].begin(), hits_[t].end());
+    }
+    if (params_.minNeighbors > 0) {
+        std::vector<int> neighbors;
+        cv::groupRectangles(faces, neighbors, params_.minNeighbors, kGroupEps);
+        suppressOverlaps(faces, neighbors);
+    }
+    toGrey(faces, d);
+    return 0;
+}
+
+int FaceDetector::detectInRegion(const cv::Mat &grey, cv::Rect region, std::vector<cv::Rect> &faces, int minSize) {
+    faces.clear();
+    if (!loaded()) {
+        return -1;
+    }
+    region &= cv::Rect(0, 0, grey.cols, grey.rows);
+    if (region.width < 24 || region.height < 24) {
+        return 0;
+    }
+
+    // equalize the region on its own copy, the caller's image stays untouched
+    if (params_.equalize) {
+        cv::equalizeHist(grey(region), roi_);
+    } else {
+        grey(region).copyTo(roi_);
+    }
+    cv::Size limit(std::max(minSize, params_.minSize.width), std::max(minSize, params_.minSize.height));
+    cascade_.detectMultiScale(roi_, faces, params_.scaleFactor, params_.minNeighbors, 0, limit, params_.maxSize);
+
+    for (size_t i = 0; i < faces.size(); i++) {
+        faces[i].x += region.x;
+        faces[i].y += region.y;
+    }
+    return 0;
+}
+
+void suppressOverlaps(std::vector<cv::Rect> &boxes, std::vector<int> &scores, double overlap) {
+    // best first, so a box only has to be checked against the ones already kept
+    std::vector<size_t> order(boxes.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scores[a] > scores[b]; });
+
+    std::vector<cv::Rect> keptBoxes;
+    std::vector<int> keptScores;
+    for (size_t k = 0; k < order.size(); k++) {
+        const cv::Rect &box = boxes[order[k]];
+        bool keep = true;
+        for (size_t j = 0; j < keptBoxes.size() && keep; j++) {
+            double inter = (box & keptBoxes[j]).area();
+            double uni = box.area() + keptBoxes[j].area() - inter;
+            keep = inter < box.area() && inter < keptBoxes[j].area() && (uni <= 0 || inter / uni <= overlap);
+        }
+        if (keep) {
+            keptBoxes.push_back(box);
+            keptScores.push_back(scores[order[k]]);
+        }
+    }
+    boxes.swap(keptBoxes);
+    scores.swap(keptScores);
+}
+
+FaceDetectorPool::FaceDetectorPool(const FaceDetectorParams &params) : params_(params), warned_(false) {}
+
+FaceDetector *FaceDetectorPool::local() {
+    const std::thread::id self = std::this_thread::get_id();
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::map<std::thread::id, std::unique_ptr<FaceDetector> >::iterator it = detectors_.find(self);
+        if (it != detectors_.end()) {
+            return it->second->loaded() ? it->second.get() : NULL;
+        }
+    }
+
+    // only this thread adds its own entry, so the cascade loads outside the
+    // lock. A detector whose model failed to load is kept as well, so the
+    // load is not retried on every frame.
+    std::unique_ptr<FaceDetector> d(new FaceDetector(params_));
+    std::string error;
+    if (!d->load(&error) && !warned_.exchange(true)) {
+        fprintf(stderr, "%s\n", error.c_str());
+    }
+    FaceDetector *detector = d->loaded() ? d.get() : NULL;
+    std::lock_guard<std::mutex> guard(lock_);
+    detectors_[self] = std::move(d);
+    return detector;
+}
+
+void FaceDetectorPool::release() {
+    std::unique_ptr<FaceDetector> d;
+    std::lock_guard<std::mutex> guard(lock_);
+    std::map<std::thread::id, std::unique_ptr<FaceDetector> >::iterator it = detectors_.find(std::this_thread::get_id());
+    if (it != detectors_.end()) {
+        d.swap(it->second);
+        detectors_.erase(it);
+    }
+}
+
+int FaceDetectorPool::detect(const cv::Mat &grey, std::vector<cv::Rect> &faces) {
+    FaceDetector *detector = local();
+    if (!detector) {
+        faces.clear();
+        return -1;
+    }
+    return params_.parallel ? detector->detectParallel(grey, faces, *this) : detector->detect(grey, faces);
+}
+
+FaceDetectorPool &defaultFaceDetectors() {
+    static FaceDetectorPool pool;
+    return pool;
+}
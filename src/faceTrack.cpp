@@ -0,0 +1,161 @@
+/**
+ * @file faceTrack.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief detect-then-track face tracker on top of FaceDetector
+ * @version 0.1
+ * @date 2024-02-22
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/opencv.hpp>
+#include "faceTrack.h"
+
+cv::Rect FaceTrack::rect() const {
+    return cv::Rect(cvRound(center.x - size.width / 2), cvRound(center.y - size.height / 2),
+                    cvRound(size.width), cvRound(size.height));
+}
+
+double rectIoU(const cv::Rect &a, const cv::Rect &b) {
+    double inter = (a & b).area();
+    double uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0.0;
+}
+
+FaceTracker::FaceTracker(const FaceTrackerParams &params)
+    : params_(params), framesSinceDetect_(0), nextId_(0), lastFull_(false) {
+}
+
+void FaceTracker::reset() {
+    tracks_.clear();
+    framesSinceDetect_ = 0;
+}
+
+// alpha-beta update with a measured box
+void FaceTracker::correct(FaceTrack &t, const cv::Rect &measured) {
+    cv::Point2d z(measured.x + measured.width / 2.0, measured.y + measured.height / 2.0);
+    cv::Point2d residual = z - t.center;
+    t.center += params_.alpha * residual;
+    t.velocity += params_.beta * residual;
+    t.size.width += params_.alpha * (measured.width - t.size.width);
+    t.size.height += params_.alpha * (measured.height - t.size.height);
+    t.confidence = 1.0;
+    t.misses = 0;
+}
+
+void FaceTracker::addTrack(const cv::Rect &measured) {
+    FaceTrack t;
+    t.id = nextId_++;
+    t.center = cv::Point2d(measured.x + measured.width / 2.0, measured.y + measured.height / 2.0);
+    t.velocity = cv::Point2d(0, 0);
+    t.size = cv::Size2d(measured.width, measured.height);
+    t.confidence = 1.0;
+    t.misses = 0;
+    t.age = 0;
+    tracks_.push_back(t);
+}
+
+FaceDetectorPool &FaceTracker::detectors() const {
+    return params_.detectors ? *params_.detectors : defaultFaceDetectors();
+}
+
+int FaceTracker::update(cv::Mat &grey, std::vector<cv::Rect> &faces) {
+    if (grey.empty()) {
+        return -1;
+    }
+    // this thread's cascade, so trackers on different threads detect in parallel
+    FaceDetectorPool &pool = detectors();
+    FaceDetector *detector = pool.local();
+    if (!detector) {
+        faces.clear();
+        return -1;
+    }
+
+    // predict: move every track along its velocity
+    bool unsure = false;
+    for (size_t i = 0; i < tracks_.size(); i++) {
+        tracks_[i].center += tracks_[i].velocity;
+        tracks_[i].age++;
+        unsure = unsure || tracks_[i].confidence < params_.minConfidence;
+    }
+
+    framesSinceDetect_++;
+    lastFull_ = tracks_.empty() || unsure || framesSinceDetect_ >= params_.detectInterval;
+
+    if (lastFull_) {
+        // full-frame cascade, then greedy assignment by overlap
+        framesSinceDetect_ = 0;
+        pool.detect(grey, detections_);
+
+        std::vector<bool> used(detections_.size(), false);
+        for (size_t i = 0; i < tracks_.size(); i++) {
+            FaceTrack &t = tracks_[i];
+            int best = -1;
+            double bestIoU = params_.matchIoU;
+            for (size_t d = 0; d < detections_.size(); d++) {
+                double iou = used[d] ? 0.0 : rectIoU(t.rect(), detections_[d]);
+                if (iou >= bestIoU) {
+                    bestIoU = iou;
+                    best = (int)d;
+                }
+            }
+            if (best >= 0) {
+                used[best] = true;
+                correct(t, detections_[best]);
+            } else {
+                t.misses++;
+                t.confidence *= 0.5;
+            }
+        }
+        for (size_t d = 0; d < detections_.size(); d++) {
+            if (!used[d]) {
+                addTrack(detections_[d]);
+            }
+        }
+    } else {
+        // only search a window around each predicted face
+        for (size_t i = 0; i < tracks_.size(); i++) {
+            FaceTrack &t = tracks_[i];
+            cv::Rect predicted = t.rect();
+            double w = t.size.width * params_.searchScale, h = t.size.height * params_.searchScale;
+            cv::Rect window(cvRound(t.center.x - w / 2), cvRound(t.center.y - h / 2), cvRound(w), cvRound(h));
+
+            detector->detectInRegion(grey, window, detections_, (int)(t.size.width * 0.6));
+
+            int best = -1;
+            double bestIoU = 0.0;
+            for (size_t d = 0; d < detections_.size(); d++) {
+                double iou = rectIoU(predicted, detections_[d]);
+                if (iou > bestIoU) {
+                    bestIoU = iou;
+                    best = (int)d;
+                }
+            }
+            if (best >= 0) {
+                correct(t, detections_[best]);
+            } else {
+                t.misses++;
+                t.confidence *= 0.5;
+            }
+        }
+    }
+
+    // drop tracks that have been lost for too long
+    std::vector<FaceTrack> alive;
+    for (size_t i = 0; i < tracks_.size(); i++) {
+        if (tracks_[i].misses <= params_.maxMisses) {
+            alive.push_back(tracks_[i]);
+        }
+    }
+    tracks_.swap(alive);
+
+    faces.clear();
+    cv::Rect frame(0, 0, grey.cols, grey.rows);
+    for (size_t i = 0; i < tracks_.size(); i++) {
+        cv::Rect r = tracks_[i].rect() & frame;
+        if (r.area() > 0) {
+            faces.push_back(r);
+        }
+    }
+    return 0;
+}
@@ -8,246 +8,426 @@
 
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
 #include "filter.h"
+#include "blurKernel.h"
+#include "kernels.h"
+#include "lut.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "stencil.h"
+#include "warp.h"
+
+// Stencil filters read neighbouring source rows after the output rows above
+// them were written, so an in-place call works on a private copy. The header
+// copy also keeps the source alive when dst is reallocated.
+static cv::Mat stencilInput(cv::Mat &src, cv::Mat &dst) {
+    if (src.data == dst.data) {
+        return src.clone();
+    }
+    return src;
+}
+
+// copy the top and bottom n rows of src into dst unchanged
+static void copyBorderRows(const cv::Mat &src, cv::Mat &dst, int n) {
+    size_t rowBytes = (size_t)src.cols * src.elemSize();
+    for (int y = 0; y < n && y < src.rows; y++) {
+        memcpy(dst.ptr<uchar>(y), src.ptr<uchar>(y), rowBytes);
+        memcpy(dst.ptr<uchar>(src.rows - 1 - y), src.ptr<uchar>(src.rows - 1 - y), rowBytes);
+    }
+}
 
 // altgreyscale for Task 4
-int greyscale(cv::Mat &src, cv::Mat &dst) {
+int greyscale(cv::Mat &src, cv::Mat &dst, int channels) {
+    PROFILE_SCOPE("greyscale");
     // Check if the source is empty
-    if (src.empty()) {
+    if (src.empty() || src.type() != CV_8UC3 || (channels != 1 && channels != 3)) {
         return -1;
     }
+    cv::Mat in = src;
+    dst.create(in.size(), CV_8UC(channels));
+
+    // the average of the three channels, looked up by their sum
+    const uchar *average = greyAverageTable();
+
     // loop for each pixel of the src
-    for (int y = 0; y < src.rows; y++){
-      for (int x = 0; x < src.cols; x++){
-            // by using the average RGB algorithm to get the alt grayscale
-            cv::Vec3b pixel = src.at<cv::Vec3b>(y, x);
-            uchar avg = (pixel[0] + pixel[1] + pixel[2]) / 3; // Average of RGB
-            dst.at<cv::Vec3b>(y, x) = cv::Vec3b(avg, avg, avg);
-      }
-    }
+    parallelRows(0, in.rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const uchar *sptr = in.ptr<uchar>(y);
+            uchar *dptr = dst.ptr<uchar>(y);
+            if (channels == 1) {
+                // luminance only: a third of the bytes for the filters that follow
+                for (int x = 0; x < in.cols; x++) {
+                    dptr[x] = average[sptr[3 * x] + sptr[3 * x + 1] + sptr[3 * x + 2]];
+                }
+                continue;
+            }
+            for (int x = 0; x < in.cols * 3; x += 3) {
+                // by using the average RGB algorithm to get the alt grayscale
+                uchar avg = average[sptr[x] + sptr[x + 1] + sptr[x + 2]];
+                dptr[x] = avg;
+                dptr[x + 1] = avg;
+                dptr[x + 2] = avg;
+            }
+        }
+    });
     return 0;
 }
 
 // sepiaTone for Task 5
 
 int sepiaTone(cv::Mat &src, cv::Mat &dst) {
-    if (src.empty()) {
+    PROFILE_SCOPE("sepiaTone");
+    if (src.empty() || src.type() != CV_8UC3) {
         return -1;
     }
-    // clone the src to dst, to make sure the original src is not changed
-    dst = src.clone();
-
-    // Calculate the center of the image
-    cv::Point center(src.cols / 2, src.rows / 2);
-    double maxDistance = cv::norm(cv::Point(0, 0) - center);
-
-    for (int y = 0; y < src.rows; y++) {
-        for (int x = 0; x < src.cols; x++) {
-            cv::Vec3b pixel = src.at<cv::Vec3b>(y, x);
-            // using the new RGB to store the original RGB, to make sure the original RGB is not changed
-            uchar newBlue   = std::min(255.0, pixel[2] * 0.272 + pixel[1] * 0.534 + pixel[0] * 0.131);
-            uchar newGreen = std::min(255.0, pixel[2] * 0.349 + pixel[1] * 0.686 + pixel[0] * 0.168);
-            uchar newRed  = std::min(255.0, pixel[2] * 0.393 + pixel[1] * 0.769 + pixel[0] * 0.189);
-            
-            dst.at<cv::Vec3b>(y, x) = cv::Vec3b(newBlue, newGreen, newRed);
-            // Calculate the distance from the center
-            double distance = cv::norm(cv::Point(x, y) - center);
-
-            // Calculate the vignetting factor
-            double vignette = std::max(0.0, 1 - distance / maxDistance);
-
-            // Apply the vignetting factor to the new RGB values
-            newBlue = std::min(255.0, newBlue * vignette);
-            newGreen = std::min(255.0, newGreen * vignette);
-            newRed = std::min(255.0, newRed * vignette);
-
-            dst.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<uchar>(newBlue), static_cast<uchar>(newGreen), static_cast<uchar>(newRed));
+    // every pixel is written from its own source pixel, so dst may alias src
+    dst.create(src.size(), src.type());
+
+    // the sepia matrix as per-channel tables, and the vignette weight of every pixel
+    const SepiaTables &sepia = sepiaTables();
+    cv::Mat vignetteWeights = vignetteMap(src.size());
+
+    parallelRows(0, src.rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const uchar *sptr = src.ptr<uchar>(y);
+            const double *vptr = vignetteWeights.ptr<double>(y);
+            uchar *dptr = dst.ptr<uchar>(y);
+            for (int x = 0; x < src.cols; x++) {
+                int b = sptr[3 * x], g = sptr[3 * x + 1], r = sptr[3 * x + 2];
+                // using the new RGB to store the original RGB, to make sure the original RGB is not changed
+                uchar newBlue  = std::min(255.0, sepia.red[0][r] + sepia.green[0][g] + sepia.blue[0][b]);
+                uchar newGreen = std::min(255.0, sepia.red[1][r] + sepia.green[1][g] + sepia.blue[1][b]);
+                uchar newRed   = std::min(255.0, sepia.red[2][r] + sepia.green[2][g] + sepia.blue[2][b]);
+
+                // Apply the vignetting factor (0..1, so no clamp needed) to the new RGB values
+                double vignette = vptr[x];
+                dptr[3 * x]     = static_cast<uchar>(newBlue * vignette);
+                dptr[3 * x + 1] = static_cast<uchar>(newGreen * vignette);
+                dptr[3 * x + 2] = static_cast<uchar>(newRed * vignette);
+            }
         }
-    }
+    });
     return 0;
 }
 
+static bool validBorder(int border) {
+    return border >= STENCIL_BORDER_KEEP && border <= STENCIL_BORDER_CONSTANT;
+}
+
+// the stencil filters take interleaved colour or a single plane
+static bool stencilType(const cv::Mat &m) {
+    return m.type() == CV_8UC3 || m.type() == CV_8UC1;
+}
+
 // 5 x 5 Gaussian blur function A
-int blur5x5_1(cv::Mat &src, cv::Mat &dst) {
-    if (src.empty()) {
+int blur5x5_1(cv::Mat &src, cv::Mat &dst, int border) {
+    PROFILE_SCOPE("blur5x5_1");
+    if (src.empty() || !stencilType(src) || !validBorder(border)) {
         return -1;
     }
-    // Clone the source to preserve the border
-    dst = src.clone(); 
-
-    int kernel[5][5] = {{1, 2, 4, 2, 1},
-                        {2, 4, 8, 4, 2},
-                        {4, 8, 16, 8, 4},
-                        {2, 4, 8, 4, 2},
-                        {1, 2, 4, 2, 1}};
-    int kernelSum = 100; // Sum of the kernel values
-
-    for (int y = 2; y < src.rows - 2; y++) {
-        for (int x = 2; x < src.cols - 2; x++) {
-            cv::Vec3i sum(0, 0, 0);
-            for (int dy = -2; dy <= 2; dy++) {
-                for (int dx = -2; dx <= 2; dx++) {
-                    cv::Vec3b pixel = src.at<cv::Vec3b>(y + dy, x + dx);
-                    for (int c = 0; c < 3; c++) {
-                        sum[c] += pixel[c] * kernel[dy + 2][dx + 2];
-                    }
-                }
-            }
-            for (int c = 0; c < 3; c++) {
-                dst.at<cv::Vec3b>(y, x)[c] = sum[c] / kernelSum;
-            }
+    cv::Mat in = stencilInput(src, dst);
+    dst.create(in.size(), in.type());
+
+    typedef Kernel2D<Taps<1, 2, 4, 2, 1>,
+                     Taps<2, 4, 8, 4, 2>,
+                     Taps<4, 8, 16, 8, 4>,
+                     Taps<2, 4, 8, 4, 2>,
+                     Taps<1, 2, 4, 2, 1> > Gauss5x5;
+    static_assert(Gauss5x5::sum == 100, "Sum of the kernel values");
+
+    // the 2-pixel border follows the border mode; with STENCIL_BORDER_KEEP it
+    // keeps the source values, as do images too small for the kernel
+    parallelRows(0, in.rows, [&](int y0, int y1) {
+        if (in.channels() == 1) {
+            applyStencil<Gauss5x5, 1, int, Gauss5x5::sum, uchar, uchar>(in, dst, y0, y1, border);
+        } else {
+            applyStencil<Gauss5x5, 3, int, Gauss5x5::sum, uchar, uchar>(in, dst, y0, y1, border);
         }
-    }
+    });
 
   return 0;
 }
 
 
-// 5 x 5 Gaussian blur function B
-int blur5x5_2(cv::Mat &src, cv::Mat &dst) {
-    if (src.empty()) {
-        return -1;
+// 5 x 5 Gaussian blur function B, rows [y0, y1) of the interior.
+// The horizontal pass feeds a rolling window of five rows; a band recomputes
+// the two halo rows above it itself, so bands are independent.
+static void blur5x5_2Band(const cv::Mat &in, cv::Mat &dst, int y0, int y1) {
+    const int rows = in.rows, cols = in.cols, cn = in.channels();
+    const size_t rowBytes = (size_t)cols * cn;
+
+    // scratch for the five horizontally blurred rows, reused between calls
+    static thread_local std::vector<uchar> ring;
+    if (ring.size() < 5 * rowBytes) {
+        ring.resize(5 * rowBytes);
     }
 
-    cv::Mat temp = src.clone();
-    dst = src.clone();
+    // the horizontal pass only covers rows 2..rows-3, the others are read unblurred
+    const uchar *window[5];
+    int next = std::max(2, y0 - 2);
+    for (int y = y0; y < y1; y++) {
+        for (; next <= y + 2 && next < rows - 2; next++) {
+            uchar *h = &ring[(next % 5) * rowBytes];
+            blur5RowH(in.ptr<uchar>(next), h, cols, cn);
+        }
+        for (int k = 0; k < 5; k++) {
+            int r = y - 2 + k;
+            window[k] = (r >= 2 && r < rows - 2) ? &ring[(r % 5) * rowBytes] : in.ptr<uchar>(r);
+        }
 
-    // Define the 1D kernel
-    int kernel[5] = {1, 2, 4, 2, 1};
-    int kernelSum = 10;  // Sum of kernel values
+        uchar *d = dst.ptr<uchar>(y);
+        const uchar *s = in.ptr<uchar>(y);
+        blur5RowV(window[0], window[1], window[2], window[3], window[4], d, cols, cn);
 
-    // Horizontal pass
-    for (int y = 2; y < src.rows - 2; y++) {
-        for (int x = 2; x < src.cols - 2; x++) {
-            cv::Vec3i sum(0, 0, 0);
-            for (int dx = -2; dx <= 2; dx++) {
-                cv::Vec3b pixel = src.at<cv::Vec3b>(y, x + dx);
-                for (int c = 0; c < 3; c++) {
-                    sum[c] += pixel[c] * kernel[dx + 2];
-                }
-            }
-            for (int c = 0; c < 3; c++) {
-                temp.at<cv::Vec3b>(y, x)[c] = sum[c] / kernelSum;
+        // the two border pixels at each end keep their source values
+        memcpy(d, s, 2 * cn);
+        memcpy(d + rowBytes - 2 * cn, s + rowBytes - 2 * cn, 2 * cn);
+    }
+}
+
+// The same blur over rows [y0, y1) of the whole image for the replicate,
+// reflect and constant borders. Every source row is blurred horizontally, the
+// two pixels at each end from a padded copy; the vertical pass then reads the
+// rows the border mode maps y - 2 .. y + 2 to, which always lie in the window.
+template <int CN>
+static void blur5x5_2BandBorder(const cv::Mat &in, cv::Mat &dst, int y0, int y1, int border) {
+    typedef Row<1, 2, 4, 2, 1> Gauss5;
+    const int rows = in.rows, cols = in.cols, cn = CN;
+    const size_t rowBytes = (size_t)cols * cn;
+
+    static thread_local std::vector<uchar> ring, zeros;
+    if (ring.size() < 5 * rowBytes) {
+        ring.resize(5 * rowBytes);
+    }
+    zeros.assign(rowBytes, 0);
+
+    const uchar *window[5];
+    int next = std::max(0, y0 - 2);
+    for (int y = y0; y < y1; y++) {
+        for (; next <= y + 2 && next < rows; next++) {
+            uchar *h = &ring[(next % 5) * rowBytes];
+            if (cols > 4) {
+                blur5RowH(in.ptr<uchar>(next), h, cols, cn);
+                stencilEdge<Gauss5, CN, unsigned, Gauss5::sum, uchar>(in, h, next, 0, 2, border);
+                stencilEdge<Gauss5, CN, unsigned, Gauss5::sum, uchar>(in, h, next, cols - 2, cols, border);
+            } else {
+                stencilEdge<Gauss5, CN, unsigned, Gauss5::sum, uchar>(in, h, next, 0, cols, border);
             }
         }
+        for (int k = 0; k < 5; k++) {
+            int r = borderIndex(y - 2 + k, rows, border);
+            window[k] = r >= 0 ? &ring[(r % 5) * rowBytes] : &zeros[0];
+        }
+        filterKernels().weightedSum5(window[0], window[1], window[2], window[3], window[4],
+                                     dst.ptr<uchar>(y), (int)rowBytes);
     }
+}
 
-    // Vertical pass
-    for (int y = 2; y < src.rows - 2; y++) {
-        for (int x = 2; x < src.cols - 2; x++) {
-            cv::Vec3i sum(0, 0, 0);
-            for (int dy = -2; dy <= 2; dy++) {
-                cv::Vec3b pixel = temp.at<cv::Vec3b>(y + dy, x);
-                for (int c = 0; c < 3; c++) {
-                    sum[c] += pixel[c] * kernel[dy + 2];
-                }
-            }
-            for (int c = 0; c < 3; c++) {
-                dst.at<cv::Vec3b>(y, x)[c] = sum[c] / kernelSum;
+// 5 x 5 Gaussian blur function B
+// separable [1 2 4 2 1] kernel, done with row pointers and the SIMD row kernels
+// in blurKernel.cpp, one band of rows per thread.
+int blur5x5_2(cv::Mat &src, cv::Mat &dst, int border) {
+    PROFILE_SCOPE("blur5x5_2");
+    if (src.empty() || !stencilType(src) || !validBorder(border)) {
+        return -1;
+    }
+
+    cv::Mat in = stencilInput(src, dst);
+    dst.create(in.size(), in.type());
+
+    const int rows = in.rows, cols = in.cols;
+
+    if (border != STENCIL_BORDER_KEEP) {
+        parallelRows(0, rows, [&](int y0, int y1) {
+            if (in.channels() == 1) {
+                blur5x5_2BandBorder<1>(in, dst, y0, y1, border);
+            } else {
+                blur5x5_2BandBorder<3>(in, dst, y0, y1, border);
             }
-        }
+        });
+        return 0;
+    }
+
+    // images too small for the kernel keep their original values
+    if (rows < 5 || cols < 5) {
+        in.copyTo(dst);
+        return 0;
     }
 
+    // the top and bottom two rows are not touched by either pass
+    copyBorderRows(in, dst, 2);
+
+    parallelRows(2, rows - 2, [&](int y0, int y1) {
+        blur5x5_2Band(in, dst, y0, y1);
+    });
+
     return 0;
 }
 
 // Task 7: Sobel_X 3 x 3 function
-int sobelX3x3( cv::Mat &src, cv::Mat &dst ){
-    if (src.empty()) {
+int sobelX3x3( cv::Mat &src, cv::Mat &dst, int border ){
+    PROFILE_SCOPE("sobelX3x3");
+    if (src.empty() || !stencilType(src) || !validBorder(border)) {
         return -1;
     }
 
-    dst.create(src.size(), CV_16SC3);
+    cv::Mat in = src;
+    dst.create(in.size(), CV_16SC(in.channels()));
 
     // Horizontal kernel [-1, 0, 1]
-    for (int y = 1; y < src.rows - 1; y++) {
-        for (int x = 1; x < src.cols - 1; x++) {
-            cv::Vec3s sum(0, 0, 0);
-            for (int dx = -1; dx <= 1; dx++) {
-                cv::Vec3b pixel = src.at<cv::Vec3b>(y, x + dx);
-                for (int c = 0; c < 3; c++) {
-                    sum[c] += pixel[c] * dx;
-                }
-            }
-            dst.at<cv::Vec3s>(y, x) = sum;
+    parallelRows(0, in.rows, [&](int y0, int y1) {
+        if (in.channels() == 1) {
+            applyStencil<Row<-1, 0, 1>, 1, int, 1, uchar, short>(in, dst, y0, y1, border);
+        } else {
+            applyStencil<Row<-1, 0, 1>, 3, int, 1, uchar, short>(in, dst, y0, y1, border);
         }
-    }
+    });
     return 0;
 
 }
 
 // Task 7: Sobel_Y 3 x 3 function
-int sobelY3x3( cv::Mat &src, cv::Mat &dst ){
-    if (src.empty()) {
+int sobelY3x3( cv::Mat &src, cv::Mat &dst, int border ){
+    PROFILE_SCOPE("sobelY3x3");
+    if (src.empty() || !stencilType(src) || !validBorder(border)) {
         return -1;
     }
 
-    dst.create(src.size(), CV_16SC3);
+    cv::Mat in = src;
+    dst.create(in.size(), CV_16SC(in.channels()));
 
     // Vertical kernel [-1, 0, 1] transposed
-    for (int y = 1; y < src.rows - 1; y++) {
-        for (int x = 1; x < src.cols - 1; x++) {
-            cv::Vec3s sum(0, 0, 0);
-            for (int dy = -1; dy <= 1; dy++) {
-                cv::Vec3b pixel = src.at<cv::Vec3b>(y + dy, x);
-                for (int c = 0; c < 3; c++) {
-                    sum[c] += pixel[c] * dy;
-                }
-            }
-            dst.at<cv::Vec3s>(y, x) = sum;
+    parallelRows(0, in.rows, [&](int y0, int y1) {
+        if (in.channels() == 1) {
+            applyStencil<Column<-1, 0, 1>, 1, int, 1, uchar, short>(in, dst, y0, y1, border);
+        } else {
+            applyStencil<Column<-1, 0, 1>, 3, int, 1, uchar, short>(in, dst, y0, y1, border);
         }
-    }
+    });
     return 0;
 
 }
 
 // Task 8: generates a gradient magnitude image from the X and Y Sobel images
 int magnitude(cv::Mat &sx, cv::Mat &sy, cv::Mat &dst) {
-    if (sx.empty() || sy.empty() || sx.size() != sy.size() || sx.type() != sy.type()) {
+    PROFILE_SCOPE("magnitude");
+    if (sx.empty() || sy.empty() || sx.size() != sy.size() || sx.type() != sy.type()
+        || (sx.type() != CV_16SC3 && sx.type() != CV_16SC1)) {
         return -1;
     }
 
-    dst.create(sx.size(), CV_8UC3);
-
-    for (int y = 0; y < sx.rows; y++) {
-        for (int x = 0; x < sx.cols; x++) {
-            cv::Vec3b magnitudeColor;
-            for (int c = 0; c < 3; c++) {
-                float gradX = sx.at<cv::Vec3s>(y, x)[c];
-                float gradY = sy.at<cv::Vec3s>(y, x)[c];
-                magnitudeColor[c] = cv::saturate_cast<uchar>(std::sqrt(gradX * gradX + gradY * gradY));
+    dst.create(sx.size(), CV_8UC(sx.channels()));
+
+    // every channel on its own, so the row is just cols * channels values
+    const int n = sx.cols * sx.channels();
+    parallelRows(0, sx.rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const short *xptr = sx.ptr<short>(y);
+            const short *yptr = sy.ptr<short>(y);
+            uchar *dptr = dst.ptr<uchar>(y);
+            for (int i = 0; i < n; i++) {
+                float gradX = xptr[i];
+                float gradY = yptr[i];
+                dptr[i] = cv::saturate_cast<uchar>(std::sqrt(gradX * gradX + gradY * gradY));
             }
-            dst.at<cv::Vec3b>(y, x) = magnitudeColor;
         }
+    });
+    return 0;
+}
+
+// One row of the fused gradient: magnitude and / or emboss of row y of a
+// CV_8UC3 or CV_8UC1 image, from the rows above and below it. NULL outputs are skipped.
+static void gradientRow(const cv::Mat &in, int y, uchar *mptr, uchar *eptr) {
+    const int rows = in.rows, cn = in.channels();
+    const int rowBytes = in.cols * cn;
+
+    // the first and last row have no vertical neighbours
+    if (y == 0 || y == rows - 1) {
+        if (mptr) memset(mptr, 0, rowBytes);
+        if (eptr) memset(eptr, 128, rowBytes);
+        return;
     }
+
+    const uchar *up = in.ptr<uchar>(y - 1);
+    const uchar *mid = in.ptr<uchar>(y);
+    const uchar *down = in.ptr<uchar>(y + 1);
+    int lo = std::min(cn, rowBytes), hi = std::max(lo, rowBytes - cn);
+
+    for (int i = 0; i < lo; i++) {
+        if (mptr) mptr[i] = 0;
+        if (eptr) eptr[i] = 128;
+    }
+    if (mptr && hi > lo) {
+        // the magnitude runs on the SIMD kernel picked for this CPU
+        filterKernels().gradientMag(up + lo, mid + lo, down + lo, mptr + lo, hi - lo, cn);
+    }
+    if (eptr) {
+        for (int i = lo; i < hi; i++) {
+            int gx = mid[i + cn] - mid[i - cn];
+            int gy = down[i] - up[i];
+            float e = gx * 0.7071 + gy * 0.7071;
+            eptr[i] = cv::saturate_cast<uchar>(e + 128);
+        }
+    }
+    for (int i = hi; i < rowBytes; i++) {
+        if (mptr) mptr[i] = 0;
+        if (eptr) eptr[i] = 128;
+    }
+}
+
+// Fused Sobel X / Sobel Y / magnitude / emboss
+// gx and gy are computed per pixel from the three source rows around y and
+// used right away, so the two CV_16SC3 images are never written. The outer
+// one-pixel frame has no full 3x3 neighbourhood and gets a zero gradient
+// (magnitude 0, emboss 128).
+int gradientFused(cv::Mat &src, cv::Mat *mag, cv::Mat *emboss) {
+    PROFILE_SCOPE("gradientFused");
+    if (src.empty() || !stencilType(src) || (mag == NULL && emboss == NULL)) {
+        return -1;
+    }
+
+    cv::Mat in = src;
+    if ((mag != NULL && mag->data == src.data) || (emboss != NULL && emboss->data == src.data)) {
+        in = src.clone();
+    }
+    if (mag != NULL) {
+        mag->create(in.size(), in.type());
+    }
+    if (emboss != NULL) {
+        emboss->create(in.size(), in.type());
+    }
+
+    parallelRows(0, in.rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            gradientRow(in, y, mag != NULL ? mag->ptr<uchar>(y) : NULL,
+                        emboss != NULL ? emboss->ptr<uchar>(y) : NULL);
+        }
+    });
     return 0;
 }
 
 // Task 9: blurs and quantizes the image
 int blurQuantize(cv::Mat &src, cv::Mat &dst, int levels) {
-    if (src.empty() || levels <= 0) {
+    PROFILE_SCOPE("blurQuantize");
+    // levels above 255 would make the bucket size 0
+    if (src.empty() || !stencilType(src) || levels <= 0 || levels > 255) {
         return -1;
     }
 
     // Step 1: Blur the image
     // Use a simple blur like a box filter for simplicity
-    cv::Mat blurred;
-    cv::blur(src, blurred, cv::Size(5, 5));
-
-    // Step 2: Quantize the image
-    dst = blurred.clone();
-    int bucketSize = 255 / levels;
-
-    for (int y = 0; y < dst.rows; y++) {
-        for (int x = 0; x < dst.cols; x++) {
-            cv::Vec3b &pixel = dst.at<cv::Vec3b>(y, x);
-            for (int c = 0; c < 3; c++) {
-                int bucket = pixel[c] / bucketSize;
-                pixel[c] = static_cast<uchar>(bucket * bucketSize);
-            }
-        }
-    }
+    // (cv::blur is already multi-threaded inside OpenCV)
+    cv::blur(src, dst, cv::Size(5, 5));
+
+    // Step 2: Quantize the image through the bucket table
+    cv::Mat lut;
+    quantizeLut(levels, lut);
+    applyLut(dst, dst, lut);
 
     return 0;
 }
@@ -255,123 +435,208 @@ int blurQuantize(cv::Mat &src, cv::Mat &dst, int levels) {
 // Task 11: other filter 1 - Single-Step Pixel-Wise Modification
 // negative filter
 int negativeFilter(cv::Mat &src, cv::Mat &dst) {
-    if (src.empty()) {
+    PROFILE_SCOPE("negativeFilter");
+    if (src.empty() || src.depth() != CV_8U) {
         return -1;
     }
 
-    dst = src.clone();
-    for (int y = 0; y < dst.rows; y++) {
-        for (int x = 0; x < dst.cols; x++) {
-            for (int c = 0; c < dst.channels(); c++) {
-                dst.at<cv::Vec3b>(y, x)[c] = 255 - dst.at<cv::Vec3b>(y, x)[c];
-            }
-        }
-    }
-    return 0;
+    return applyLut(src, dst, negativeLut());
 }
 
 // Task 11: other filter 2 - area effect (emboss effect)
 int embossEffect(cv::Mat &src, cv::Mat &dst) {
-    if (src.empty()) {
-        return -1;
-    }
-
-    cv::Mat sobelXOutput, sobelYOutput;
-    sobelX3x3(src, sobelXOutput); // Assuming sobelX3x3 is implemented
-    sobelY3x3(src, sobelYOutput); // Assuming sobelY3x3 is implemented
-
-    dst.create(src.size(), src.type());
+    PROFILE_SCOPE("embossEffect");
+    // the gradient is projected onto the (1, 1) direction inside the fused kernel
+    return gradientFused(src, NULL, &dst);
+}
 
-    for (int y = 0; y < src.rows; y++) {
-        for (int x = 0; x < src.cols; x++) {
-            cv::Vec3s gradX = sobelXOutput.at<cv::Vec3s>(y, x);
-            cv::Vec3s gradY = sobelYOutput.at<cv::Vec3s>(y, x);
-            for (int c = 0; c < 3; c++) {
-                float emboss = gradX[c] * 0.7071 + gradY[c] * 0.7071;
-                dst.at<cv::Vec3b>(y, x)[c] = cv::saturate_cast<uchar>(emboss + 128);
-            }
-        }
+// BGR -> grey -> BGR for pixels [x0, x1) of a row, with the fixed-point
+// weights cvtColor uses (0.299 R + 0.587 G + 0.114 B in 14-bit), so the
+// result matches the two cvtColor calls exactly
+static inline void greyBgrRow(const uchar *s, uchar *d, int x0, int x1) {
+    for (int x = x0; x < x1; x++) {
+        const uchar *p = s + x * 3;
+        uchar g = (uchar)((p[0] * 1868 + p[1] * 9617 + p[2] * 4899 + (1 << 13)) >> 14);
+        d[x * 3] = d[x * 3 + 1] = d[x * 3 + 2] = g;
     }
-
-    return 0;
 }
 
 // Task 11: other filter 3 - face detect (colorful faces, grayscale background)
+// One pass over the frame: every row is split at the faces crossing it, the
+// spans outside go grey and the spans inside are copied, so each pixel is
+// read and written once instead of by two cvtColor passes and a copy back.
 int colorfulFaces(cv::Mat &src, std::vector<cv::Rect> &faces, cv::Mat &dst) {
-    if (src.empty()) {
+    PROFILE_SCOPE("colorfulFaces");
+    if (src.empty() || src.type() != CV_8UC3) {
         return -1;
     }
 
-    cv::cvtColor(src, dst, cv::COLOR_BGR2GRAY);
-    cv::cvtColor(dst, dst, cv::COLOR_GRAY2BGR);
-
+    cv::Mat in = src;
+    dst.create(in.size(), CV_8UC3);
+    const cv::Rect frame(0, 0, in.cols, in.rows);
+    std::vector<cv::Rect> boxes;
     for (const auto &face : faces) {
-        src(face).copyTo(dst(face));
+        cv::Rect box = face & frame;
+        if (box.area() > 0) {
+            boxes.push_back(box);
+        }
     }
+
+    parallelRows(0, in.rows, [&](int y0, int y1) {
+        std::vector<std::pair<int, int> > spans;
+        for (int y = y0; y < y1; y++) {
+            spans.clear();
+            for (const auto &box : boxes) {
+                if (box.y <= y && y < box.y + box.height) {
+                    spans.push_back(std::make_pair(box.x, box.x + box.width));
+                }
+            }
+            std::sort(spans.begin(), spans.end());
+
+            const uchar *sptr = in.ptr<uchar>(y);
+            uchar *dptr = dst.ptr<uchar>(y);
+            int x = 0;
+            for (const auto &span : spans) {
+                greyBgrRow(sptr, dptr, x, span.first);
+                // in place the face is already there
+                if (span.second > x && sptr != dptr) {
+                    int from = std::max(x, span.first);
+                    memcpy(dptr + from * 3, sptr + from * 3, (size_t)(span.second - from) * 3);
+                }
+                x = std::max(x, span.second);
+            }
+            greyBgrRow(sptr, dptr, x, in.cols);
+        }
+    });
     return 0;
 }
 
 
 // Extension Part 1: 
 // cartoonized the live video
+// The frame is done in horizontal strips small enough to stay in L2: each
+// strip is box-blurred (plus the two halo rows either side), quantized through
+// the bucket table and thresholded against the gradient of the same row as it
+// is written, so no full-frame intermediate is ever made.
 int cartoon(cv::Mat &src, cv::Mat &dst, int levels, int magThreshold) {
-  // generate the gradient magnitude
-  cv::Mat sobelx;
-  sobelX3x3(src, sobelx);
-  cv::Mat sobely;
-  sobelY3x3(src, sobely);
-  cv::Mat mag;
-  magnitude(sobelx, sobely, mag);
-
-  // generate the blurred and quantized image
-  cv::Mat quantize;
-  blurQuantize(src, quantize, levels);
-
-  dst = cv::Mat::zeros(src.size(), CV_8UC3);
-
-  // apply the threshold
-  for (int i = 0; i < src.rows; i++)
-  {
-    cv::Vec3b *dptr = dst.ptr<cv::Vec3b>(i);
-    cv::Vec3b *mptr = mag.ptr<cv::Vec3b>(i);
-    cv::Vec3b *qptr = quantize.ptr<cv::Vec3b>(i);
-
-    for (int j = 0; j < src.cols; j++)
-    {
-      for (int c = 0; c < 3; c++)
-      {
-        // only copy the quantized image if the magnitude is lower than the threshold
-        if (mptr[j][c] <= magThreshold)
-        {
-          dptr[j][c] = qptr[j][c];
+  PROFILE_SCOPE("cartoon");
+  cv::Mat lut;
+  if (src.empty() || src.type() != CV_8UC3 || quantizeLut(levels, lut) != 0) {
+    return -1;
+  }
+  cv::Mat in = stencilInput(src, dst);
+  dst.create(in.size(), CV_8UC3);
+
+  const int rows = in.rows;
+  const int rowBytes = in.cols * 3;
+  // about 256 KB of blurred rows per strip
+  const int stripRows = std::max(8, (256 * 1024) / std::max(1, rowBytes));
+  const uchar *quantize = lut.ptr<uchar>(0);
+
+  parallelRows(0, rows, [&](int y0, int y1) {
+    // per-thread scratch: the blurred strip and one row of gradient magnitude
+    static thread_local cv::Mat blurred;
+    static thread_local std::vector<uchar> mag;
+    mag.resize(rowBytes);
+
+    for (int s0 = y0; s0 < y1; s0 += stripRows) {
+      int s1 = std::min(y1, s0 + stripRows);
+
+      // Step 1: blur the strip; the halo rows give the 5x5 box the same
+      // neighbours it has in the full frame, so the rows inside match exactly
+      int h0 = std::max(0, s0 - 2), h1 = std::min(rows, s1 + 2);
+      cv::blur(in.rowRange(h0, h1), blurred, cv::Size(5, 5));
+
+      for (int y = s0; y < s1; y++) {
+        // Step 2: the gradient magnitude of this row
+        gradientRow(in, y, &mag[0], NULL);
+
+        const uchar *bptr = blurred.ptr<uchar>(y - h0);
+        uchar *dptr = dst.ptr<uchar>(y);
+        for (int i = 0; i < rowBytes; i++) {
+          // only copy the quantized image if the magnitude is lower than the threshold
+          dptr[i] = (mag[i] <= magThreshold) ? quantize[bptr[i]] : 0;
         }
       }
     }
-  }
+  }, 16); // bands of 16+ rows keep the re-blurred halo rows a small overhead
 
   return (0);
 }
 
 
 void warpImage(cv::Mat &src, cv::Mat &dst, bool horizontalWarp) {
-    dst = cv::Mat::zeros(src.size(), src.type());
+    PROFILE_SCOPE("warpImage");
+    // the displacement table is built once and reused while the frame size stays
+    // the same; one engine per thread, so concurrent callers do not share it
+    static thread_local WarpEngine engine;
+
+    WarpParams params;
+    params.horizontal = horizontalWarp;
+    params.frequency = 100; // Frequency of the sine wave
+    params.amplitude = 200; // Amplitude of the sine wave
+    engine.apply(src, dst, params);
+}
 
-    double frequency = 100; // Frequency of the sine wave
-    double amplitude = 200; // Amplitude of the sine wave
+// Planar versions: every CV_8UC1 plane goes through the single-channel path.
+template <typename Filter>
+static int forEachPlane(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, Filter filter) {
+    if (src.empty()) {
+        return -1;
+    }
+    dst.resize(src.size());
+    for (size_t i = 0; i < src.size(); i++) {
+        if (src[i].channels() != 1 || filter(src[i], dst[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    for (int y = 0; y < src.rows; y++) {
-        for (int x = 0; x < src.cols; x++) {
-            int newX = x, newY = y;
+int blur5x5_1(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border) {
+    return forEachPlane(src, dst, [border](cv::Mat &s, cv::Mat &d) { return blur5x5_1(s, d, border); });
+}
 
-            if (horizontalWarp) {
-                newY = y + static_cast<int>(amplitude * sin(2 * M_PI * x / frequency));
-            } else {
-                newX = x + static_cast<int>(amplitude * sin(2 * M_PI * y / frequency));
-            }
+int blur5x5_2(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border) {
+    return forEachPlane(src, dst, [border](cv::Mat &s, cv::Mat &d) { return blur5x5_2(s, d, border); });
+}
 
-            if (newX >= 0 && newX < src.cols && newY >= 0 && newY < src.rows) {
-                dst.at<cv::Vec3b>(y, x) = src.at<cv::Vec3b>(newY, newX);
-            }
+int sobelX3x3(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border) {
+    return forEachPlane(src, dst, [border](cv::Mat &s, cv::Mat &d) { return sobelX3x3(s, d, border); });
+}
+
+int sobelY3x3(std::vector<cv::Mat> &src, std::vector<cv::Mat> &dst, int border) {
+    return forEachPlane(src, dst, [border](cv::Mat &s, cv::Mat &d) { return sobelY3x3(s, d, border); });
+}
+
+int magnitude(std::vector<cv::Mat> &sx, std::vector<cv::Mat> &sy, std::vector<cv::Mat> &dst) {
+    if (sx.empty() || sx.size() != sy.size()) {
+        return -1;
+    }
+    dst.resize(sx.size());
+    for (size_t i = 0; i < sx.size(); i++) {
+        if (sx[i].channels() != 1 || magnitude(sx[i], sy[i], dst[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int gradientFused(std::vector<cv::Mat> &src, std::vector<cv::Mat> *mag, std::vector<cv::Mat> *emboss) {
+    if (src.empty() || (mag == NULL && emboss == NULL)) {
+        return -1;
+    }
+    if (mag != NULL) {
+        mag->resize(src.size());
+    }
+    if (emboss != NULL) {
+        emboss->resize(src.size());
+    }
+    for (size_t i = 0; i < src.size(); i++) {
+        if (src[i].channels() != 1 || gradientFused(src[i], mag != NULL ? &(*mag)[i] : NULL,
+                                                    emboss != NULL ? &(*emboss)[i] : NULL) != 0) {
+            return -1;
         }
     }
-}
\ No newline at end of file
+    return 0;
+}
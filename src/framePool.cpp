@@ -0,0 +1,160 @@
+/**
+ * @file framePool.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief pooled cv::Mat allocator, so steady-state frame processing does not hit the heap
+ * @version 0.1
+ * @date 2024-03-01
+*/
+
+#include <opencv2/opencv.hpp>
+#include <cstdio>
+#include <new>
+#include "framePool.h"
+
+PoolAllocator::PoolAllocator(size_t maxPooledBytes) : maxPooledBytes_(maxPooledBytes) {
+}
+
+PoolAllocator::~PoolAllocator() {
+    trim();
+}
+
+cv::UMatData *PoolAllocator::allocate(int dims, const int *sizes, int type, void *data0, size_t *step,
+                                      cv::AccessFlag, cv::UMatUsageFlags) const {
+    // the same layout as OpenCV's own allocator: dense rows, last dimension first
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != CV_AUTOSTEP) {
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    // Mats wrapping user memory are not ours to pool
+    if (data0) {
+        cv::UMatData *u = new cv::UMatData(this);
+        u->data = u->origdata = (uchar *)data0;
+        u->size = total;
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    cv::UMatData *u = NULL;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stats_.allocations++;
+        stats_.bytesInUse += total;
+        std::unordered_map<size_t, std::vector<cv::UMatData *> >::iterator it = free_.find(total);
+        if (it != free_.end() && !it->second.empty()) {
+            u = it->second.back();
+            it->second.pop_back();
+            stats_.reused++;
+            stats_.bytesPooled -= total;
+        } else {
+            stats_.heapAllocs++;
+        }
+    }
+
+    if (u) {
+        // a fresh header around the pooled buffer
+        uchar *buffer = u->origdata;
+        u->~UMatData();
+        new (u) cv::UMatData(this);
+        u->data = u->origdata = buffer;
+        u->size = total;
+        return u;
+    }
+
+    u = new cv::UMatData(this);
+    u->data = u->origdata = (uchar *)cv::fastMalloc(total);
+    u->size = total;
+    return u;
+}
+
+bool PoolAllocator::allocate(cv::UMatData *u, cv::AccessFlag, cv::UMatUsageFlags) const {
+    // host memory only, nothing to map
+    return u != NULL;
+}
+
+void PoolAllocator::deallocate(cv::UMatData *u) const {
+    if (!u) {
+        return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+
+    if (u->flags & cv::UMatData::USER_ALLOCATED) {
+        delete u;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stats_.bytesInUse -= u->size;
+        if (stats_.bytesPooled + u->size <= maxPooledBytes_) {
+            std::vector<cv::UMatData *> &list = free_[u->size];
+            if (list.capacity() == 0) {
+                // room for a few frames, so steady state never grows the list
+                list.reserve(8);
+            }
+            list.push_back(u);
+            stats_.bytesPooled += u->size;
+            return;
+        }
+        stats_.heapFrees++;
+    }
+    cv::fastFree(u->origdata);
+    u->origdata = 0;
+    delete u;
+}
+
+PoolStats PoolAllocator::stats() const {
+    std::lock_guard<std::mutex> guard(lock_);
+    return stats_;
+}
+
+void PoolAllocator::trim() {
+    std::unordered_map<size_t, std::vector<cv::UMatData *> > released;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        released.swap(free_);
+        for (std::unordered_map<size_t, std::vector<cv::UMatData *> >::iterator it = released.begin();
+             it != released.end(); ++it) {
+            stats_.heapFrees += it->second.size();
+        }
+        stats_.bytesPooled = 0;
+    }
+    for (std::unordered_map<size_t, std::vector<cv::UMatData *> >::iterator it = released.begin();
+         it != released.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); i++) {
+            cv::fastFree(it->second[i]->origdata);
+            it->second[i]->origdata = 0;
+            delete it->second[i];
+        }
+    }
+}
+
+static PoolAllocator *installedPool = NULL;
+
+PoolAllocator &installFramePool() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        installedPool = new PoolAllocator();
+        cv::Mat::setDefaultAllocator(installedPool);
+    });
+    return *installedPool;
+}
+
+PoolAllocator *framePool() {
+    return installedPool;
+}
+
+void printPoolStats(const PoolStats &s) {
+    printf("Frame pool: %lld buffers handed out, %lld reused, %lld from the heap, %lld returned to the heap;"
+           " %.1f MB in use, %.1f MB pooled\n",
+           s.allocations, s.reused, s.heapAllocs, s.heapFrees,
+           s.bytesInUse / (1024.0 * 1024.0), s.bytesPooled / (1024.0 * 1024.0));
+}
@@ -0,0 +1,156 @@
+/**
+ * @file kernels.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief picks the row kernel variant for this CPU at run time
+ * @version 0.1
+ * @date 2024-03-05
+*/
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "kernels.h"
+
+// the variants, defined in kernelsScalar.cpp, kernelsSSE41.cpp, ...
+namespace scalar { extern const FilterKernels kernels; }
+#ifdef FILTER_KERNELS_X86
+namespace sse41 { extern const FilterKernels kernels; }
+namespace avx2 { extern const FilterKernels kernels; }
+namespace avx512 { extern const FilterKernels kernels; }
+#endif
+
+// can this CPU run the variant?
+static bool cpuSupports(const FilterKernels &k) {
+#ifdef FILTER_KERNELS_X86
+    __builtin_cpu_init();
+    if (&k == &sse41::kernels) {
+        return __builtin_cpu_supports("sse4.1");
+    }
+    if (&k == &avx2::kernels) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (&k == &avx512::kernels) {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    }
+#endif
+    return &k == &scalar::kernels;
+}
+
+std::vector<const FilterKernels *> availableFilterKernels() {
+    // narrowest first, so the last one is the widest
+    const FilterKernels *all[] = {
+        &scalar::kernels,
+#ifdef FILTER_KERNELS_X86
+        &sse41::kernels, &avx2::kernels, &avx512::kernels,
+#endif
+    };
+    std::vector<const FilterKernels *> usable;
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (cpuSupports(*all[i])) {
+            usable.push_back(all[i]);
+        }
+    }
+    return usable;
+}
+
+static const FilterKernels *findKernels(const char *isa) {
+    std::vector<const FilterKernels *> usable = availableFilterKernels();
+    for (size_t i = 0; i < usable.size(); i++) {
+        if (strcmp(usable[i]->isa, isa) == 0) {
+            return usable[i];
+        }
+    }
+    return NULL;
+}
+
+// the widest variant, or the one FILTER_ISA asks for
+static const FilterKernels *defaultKernels() {
+    const char *forced = getenv("FILTER_ISA");
+    if (forced && *forced) {
+        const FilterKernels *k = findKernels(forced);
+        if (k) {
+            return k;
+        }
+        fprintf(stderr, "FILTER_ISA=%s is not available on this build / CPU, using the default\n", forced);
+    }
+    return availableFilterKernels().back();
+}
+
+static std::atomic<const FilterKernels *> current(NULL);
+
+const FilterKernels &filterKernels() {
+    const FilterKernels *k = current.load(std::memory_order_acquire);
+    if (!k) {
+        // every thread that races here picks the same variant
+        k = defaultKernels();
+        current.store(k, std::memory_order_release);
+    }
+    return *k;
+}
+
+int selectFilterKernels(const char *isa) {
+    const FilterKernels *k = findKernels(isa);
+    if (!k) {
+        return -1;
+    }
+    current.store(k, std::memory_order_release);
+    return 0;
+}
+
+int verifyFilterKernels(bool verbose) {
+    const FilterKernels &ref = scalar::kernels;
+    std::vector<const FilterKernels *> usable = availableFilterKernels();
+    std::mt19937 rng(5330);
+    int failures = 0;
+
+    // every length up to a few vector widths, at every alignment, plus long rows,
+    // for single-channel and interleaved colour rows; rows hold n + 16 bytes
+    // so gradientMag can read cn bytes either side
+    std::vector<int> lengths;
+    for (int n = 0; n <= 200; n++) {
+        lengths.push_back(n);
+    }
+    lengths.push_back(1917);
+    lengths.push_back(3840 * 3);
+
+    for (size_t v = 0; v < usable.size(); v++) {
+        const FilterKernels &k = *usable[v];
+        int bad = 0;
+        for (size_t li = 0; li < lengths.size(); li++) {
+            int n = lengths[li];
+            for (int cn = 1; cn <= 3; cn += 2) {
+                for (int offset = 0; offset < 4; offset++) {
+                    std::vector<unsigned char> rows[5], want(n + 1), got(n + 1);
+                    for (int r = 0; r < 5; r++) {
+                        rows[r].resize(n + 16);
+                        for (size_t i = 0; i < rows[r].size(); i++) {
+                            // extremes often, to hit the saturation and rounding edges
+                            int x = rng() % 4;
+                            rows[r][i] = x == 0 ? 0 : x == 1 ? 255 : (unsigned char)rng();
+                        }
+                    }
+                    const unsigned char *p[5];
+                    for (int r = 0; r < 5; r++) {
+                        p[r] = &rows[r][cn + offset];
+                    }
+
+                    ref.weightedSum5(p[0], p[1], p[2], p[3], p[4], &want[0], n);
+                    k.weightedSum5(p[0], p[1], p[2], p[3], p[4], &got[0], n);
+                    bad += memcmp(&want[0], &got[0], n) != 0;
+
+                    ref.gradientMag(p[0], p[1], p[2], &want[0], n, cn);
+                    k.gradientMag(p[0], p[1], p[2], &got[0], n, cn);
+                    bad += memcmp(&want[0], &got[0], n) != 0;
+                }
+            }
+        }
+        if (verbose) {
+            printf("%-8s %s\n", k.isa, bad ? "MISMATCH" : "ok");
+        }
+        failures += bad;
+    }
+    return failures;
+}
@@ -0,0 +1,11 @@
+/**
+ * @file kernelsAVX2.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row kernels, AVX2 build, compiled with -mavx2
+ * @version 0.1
+ * @date 2024-03-05
+*/
+
+#define KERNEL_NS avx2
+#define KERNEL_ISA_NAME "avx2"
+#include "kernelsImpl.h"
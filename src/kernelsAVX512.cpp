@@ -0,0 +1,11 @@
+/**
+ * @file kernelsAVX512.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row kernels, AVX-512BW build, compiled with -mavx512f -mavx512bw
+ * @version 0.1
+ * @date 2024-03-05
+*/
+
+#define KERNEL_NS avx512
+#define KERNEL_ISA_NAME "avx512"
+#include "kernelsImpl.h"
@@ -0,0 +1,11 @@
+/**
+ * @file kernelsSSE41.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row kernels, SSE4.1 build, compiled with -msse4.1
+ * @version 0.1
+ * @date 2024-03-05
+*/
+
+#define KERNEL_NS sse41
+#define KERNEL_ISA_NAME "sse4.1"
+#include "kernelsImpl.h"
@@ -0,0 +1,12 @@
+/**
+ * @file kernelsScalar.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row kernels, baseline build, no SIMD: the reference every other variant is checked against
+ * @version 0.1
+ * @date 2024-03-05
+*/
+
+#define KERNEL_NS scalar
+#define KERNEL_ISA_NAME "scalar"
+#define KERNEL_SCALAR
+#include "kernelsImpl.h"
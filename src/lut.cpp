@@ -0,0 +1,133 @@
+/**
+ * @file lut.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief lookup tables for the point-wise colour filters
+ * @version 0.1
+ * @date 2024-02-26
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <mutex>
+#include "lut.h"
+#include "parallel.h"
+
+const cv::Mat &identityLut() {
+    static const cv::Mat lut = []() {
+        cv::Mat t(1, 256, CV_8U);
+        uchar *p = t.ptr<uchar>(0);
+        for (int i = 0; i < 256; i++) {
+            p[i] = static_cast<uchar>(i);
+        }
+        return t;
+    }();
+    return lut;
+}
+
+const cv::Mat &negativeLut() {
+    static const cv::Mat lut = []() {
+        cv::Mat t(1, 256, CV_8U);
+        uchar *p = t.ptr<uchar>(0);
+        for (int i = 0; i < 256; i++) {
+            p[i] = static_cast<uchar>(255 - i);
+        }
+        return t;
+    }();
+    return lut;
+}
+
+int quantizeLut(int levels, cv::Mat &lut) {
+    // levels above 255 would make the bucket size 0
+    if (levels <= 0 || levels > 255) {
+        return -1;
+    }
+    int bucketSize = 255 / levels;
+    lut.create(1, 256, CV_8U);
+    uchar *p = lut.ptr<uchar>(0);
+    for (int i = 0; i < 256; i++) {
+        int bucket = i / bucketSize;
+        p[i] = static_cast<uchar>(bucket * bucketSize);
+    }
+    return 0;
+}
+
+void affineLut(double alpha, double beta, cv::Mat &lut) {
+    // run convertTo itself over every input value, so the table rounds exactly as it does
+    identityLut().convertTo(lut, -1, alpha, beta);
+}
+
+void composeLut(const cv::Mat &first, const cv::Mat &second, cv::Mat &lut) {
+    cv::Mat out(1, 256, CV_8U);
+    const uchar *f = first.ptr<uchar>(0);
+    const uchar *s = second.ptr<uchar>(0);
+    uchar *p = out.ptr<uchar>(0);
+    for (int i = 0; i < 256; i++) {
+        p[i] = s[f[i]];
+    }
+    lut = out;
+}
+
+int applyLut(cv::Mat &src, cv::Mat &dst, const cv::Mat &lut) {
+    if (src.empty() || src.depth() != CV_8U || lut.total() != 256 || lut.type() != CV_8U) {
+        return -1;
+    }
+    // cv::LUT is vectorised and splits large images across threads itself
+    cv::LUT(src, lut, dst);
+    return 0;
+}
+
+const uchar *greyAverageTable() {
+    static uchar table[766];
+    static std::once_flag once;
+    std::call_once(once, []() {
+        for (int s = 0; s < 766; s++) {
+            table[s] = static_cast<uchar>(s / 3);
+        }
+    });
+    return table;
+}
+
+const SepiaTables &sepiaTables() {
+    static SepiaTables tables;
+    static std::once_flag once;
+    std::call_once(once, []() {
+        // the same coefficients and products as the per-pixel formula in sepiaTone
+        const double fromRed[3] = {0.272, 0.349, 0.393};
+        const double fromGreen[3] = {0.534, 0.686, 0.769};
+        const double fromBlue[3] = {0.131, 0.168, 0.189};
+        for (int c = 0; c < 3; c++) {
+            for (int v = 0; v < 256; v++) {
+                tables.red[c][v] = v * fromRed[c];
+                tables.green[c][v] = v * fromGreen[c];
+                tables.blue[c][v] = v * fromBlue[c];
+            }
+        }
+    });
+    return tables;
+}
+
+cv::Mat vignetteMap(cv::Size size) {
+    static std::mutex lock;
+    static cv::Mat cached;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (cached.size() == size) {
+        return cached;
+    }
+
+    // a new Mat, so callers still holding the previous map keep it intact
+    cv::Mat map(size, CV_64FC1);
+    cv::Point center(size.width / 2, size.height / 2);
+    double maxDistance = cv::norm(cv::Point(0, 0) - center);
+    parallelRows(0, size.height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            double *mptr = map.ptr<double>(y);
+            for (int x = 0; x < size.width; x++) {
+                double distance = cv::norm(cv::Point(x, y) - center);
+                mptr[x] = std::max(0.0, 1 - distance / maxDistance);
+            }
+        }
+    });
+    cached = map;
+    return cached;
+}
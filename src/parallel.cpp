@@ -0,0 +1,47 @@
+/**
+ * @file parallel.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief row-band parallel execution for the filters, on top of cv::parallel_for_
+ * @version 0.1
+ * @date 2024-02-12
+*/
+
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+#include "parallel.h"
+
+// 0 = let OpenCV use every core
+static int filterThreads = 0;
+
+void setFilterThreads(int n) {
+    filterThreads = std::max(0, n);
+    // cv::parallel_for_ runs on OpenCV's pool, so size that pool to match
+    cv::setNumThreads(filterThreads == 0 ? -1 : filterThreads);
+}
+
+int getFilterThreads() {
+    return filterThreads == 0 ? cv::getNumberOfCPUs() : filterThreads;
+}
+
+void parallelRows(int begin, int end, const std::function<void(int, int)> &body, int minRows) {
+    int rows = end - begin;
+    if (rows <= 0) {
+        return;
+    }
+
+    // a few bands per thread keeps the load balanced when some rows are slower
+    int threads = getFilterThreads();
+    int bands = std::min((rows + minRows - 1) / std::max(1, minRows), threads * 4);
+    if (threads <= 1 || bands <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range &r) {
+        for (int b = r.start; b < r.end; b++) {
+            int y0 = begin + (int)((long long)rows * b / bands);
+            int y1 = begin + (int)((long long)rows * (b + 1) / bands);
+            body(y0, y1);
+        }
+    }, bands);
+}
@@ -0,0 +1,460 @@
+/**
+ * @file pipeline.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief chain of filter stages built from a spec string
+ * @version 0.1
+ * @date 2024-02-14
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "pipeline.h"
+#include "filter.h"
+#include "faceDetect.h"
+#include "faceTrack.h"
+#include "asyncFaceDetect.h"
+#include "proxy.h"
+#include "roiFilter.h"
+#include "toneAdjust.h"
+#include "warp.h"
+
+// integer option of a stage, or def when it is not given
+static int intParam(const StageParams &params, const std::string &key, int def) {
+    StageParams::const_iterator it = params.find(key);
+    return it == params.end() ? def : atoi(it->second.c_str());
+}
+
+static double doubleParam(const StageParams &params, const std::string &key, double def) {
+    StageParams::const_iterator it = params.find(key);
+    return it == params.end() ? def : atof(it->second.c_str());
+}
+
+// border=keep|replicate|reflect|constant of the stencil stages, or def
+static int borderParam(const StageParams &params, int def) {
+    StageParams::const_iterator it = params.find("border");
+    if (it == params.end()) {
+        return def;
+    }
+    const char *names[] = {"keep", "replicate", "reflect", "constant"};
+    for (int i = 0; i < 4; i++) {
+        if (it->second == names[i]) {
+            return STENCIL_BORDER_KEEP + i;
+        }
+    }
+    return def;
+}
+
+// The detector pool for a set of cascade settings. Stages with the same
+// settings share one, and it outlives them: a chain is parsed again on every
+// mode switch, and a new pool would load the cascade again on every thread.
+static std::shared_ptr<FaceDetectorPool> sharedDetectors(const FaceDetectorParams &detect) {
+    static std::mutex lock;
+    static std::map<std::string, std::shared_ptr<FaceDetectorPool> > pools;
+
+    std::ostringstream key;
+    key << detect.model << '|' << detect.downscale << '|' << detect.equalize << '|' << detect.scaleFactor << '|'
+        << detect.minNeighbors << '|' << detect.minSize.width << 'x' << detect.minSize.height << '|'
+        << detect.maxSize.width << 'x' << detect.maxSize.height << '|' << detect.parallel;
+    std::lock_guard<std::mutex> guard(lock);
+    std::shared_ptr<FaceDetectorPool> &pool = pools[key.str()];
+    if (!pool) {
+        pool = std::make_shared<FaceDetectorPool>(detect);
+    }
+    return pool;
+}
+
+// tracker settings of the face stages: interval=N, and the cascade options
+// model=path, neighbors=N, step=S (detectMultiScale's scaleFactor) and
+// minFace=pixels (at the detection scale) and parallel=0|1
+// (FaceDetectorParams::parallel); a stage that sets any of these uses the
+// pool shared by all stages with the same settings
+static FaceTrackerParams trackerParams(const StageParams &params) {
+    FaceTrackerParams track;
+    track.detectInterval = std::max(1, intParam(params, "interval", track.detectInterval));
+    if (params.count("model") || params.count("neighbors") || params.count("step") || params.count("minFace") ||
+        params.count("parallel")) {
+        FaceDetectorParams detect;
+        StageParams::const_iterator it = params.find("model");
+        if (it != params.end()) {
+            detect.model = it->second;
+        }
+        detect.minNeighbors = std::max(0, intParam(params, "neighbors", detect.minNeighbors));
+        detect.scaleFactor = std::max(1.01, doubleParam(params, "step", detect.scaleFactor));
+        int minFace = std::max(0, intParam(params, "minFace", 0));
+        detect.minSize = cv::Size(minFace, minFace);
+        // parallel=1: full detections split the scales and tiles over the filter threads
+        detect.parallel = intParam(params, "parallel", 0) != 0;
+        track.detectors = sharedDetectors(detect);
+    }
+    return track;
+}
+
+// the stages that find faces or draw at them, in full-frame coordinates
+static bool isFaceStage(const std::string &name) {
+    return name == "face" || name == "colorfulFaces";
+}
+
+// detect=1 of the stages that work on faces: a background detector that
+// keeps the faces of the context current; NULL when an earlier stage finds them
+static std::shared_ptr<AsyncFaceDetector> faceSource(const StageParams &params) {
+    if (!intParam(params, "detect", 0)) {
+        return std::shared_ptr<AsyncFaceDetector>();
+    }
+    double scale = doubleParam(params, "scale", 0.5);
+    return std::shared_ptr<AsyncFaceDetector>(new AsyncFaceDetector(scale, trackerParams(params)));
+}
+
+// hand the frame to the detector and take the newest faces; offline the
+// frame waits for its own faces, so the result does not depend on timing
+static void updateFaces(AsyncFaceDetector &detector, cv::Mat &src, FrameContext &ctx) {
+    detector.submit(src, ctx.frameIndex, ctx.timestamp);
+    FaceResult result;
+    if (ctx.realtime ? detector.latest(result) : detector.wait(ctx.frameIndex, result)) {
+        ctx.faces.swap(result.faces);
+    }
+}
+
+static std::string trim(const std::string &s) {
+    size_t a = s.find_first_not_of(" \t");
+    size_t b = s.find_last_not_of(" \t");
+    return a == std::string::npos ? std::string() : s.substr(a, b - a + 1);
+}
+
+// Build the run function for a named stage. Scratch images a stage needs are
+// captured by the closure so they are reused from frame to frame.
+static bool makeStage(FilterStage &stage, std::string *error) {
+    const std::string &name = stage.name;
+    const StageParams &p = stage.params;
+
+    if (name == "gray") {
+        stage.run = [](cv::Mat &src, cv::Mat &dst, FrameContext &) {
+            cv::cvtColor(src, dst, cv::COLOR_BGR2GRAY);
+            return 0;
+        };
+    } else if (name == "altgray") {
+        // channels=1 gives a single luminance plane for the stages that follow
+        int channels = intParam(p, "channels", 3);
+        stage.run = [channels](cv::Mat &src, cv::Mat &dst, FrameContext &) { return greyscale(src, dst, channels); };
+    } else if (name == "sepia") {
+        stage.run = [](cv::Mat &src, cv::Mat &dst, FrameContext &) { return sepiaTone(src, dst); };
+    } else if (name == "blur") {
+        stage.planar = true;
+        int border = borderParam(p, STENCIL_BORDER_KEEP);
+        stage.run = [border](cv::Mat &src, cv::Mat &dst, FrameContext &) { return blur5x5_2(src, dst, border); };
+    } else if (name == "sobelX" || name == "sobelY") {
+        stage.planar = true;
+        bool xDir = name == "sobelX";
+        int border = borderParam(p, STENCIL_BORDER_REFLECT);
+        std::shared_ptr<cv::Mat> grad(new cv::Mat);
+        stage.run = [xDir, border, grad](cv::Mat &src, cv::Mat &dst, FrameContext &) {
+            int ret = xDir ? sobelX3x3(src, *grad, border) : sobelY3x3(src, *grad, border);
+            if (ret == 0) {
+                cv::convertScaleAbs(*grad, dst);
+            }
+            return ret;
+        };
+    } else if (name == "magnitude") {
+        stage.planar = true;
+        stage.run = [](cv::Mat &src, cv::Mat &dst, FrameContext &) { return gradientFused(src, &dst, NULL); };
+    } else if (name == "quantize") {
+        stage.planar = true;
+        int levels = intParam(p, "levels", 10);
+        stage.run = [levels](cv::Mat &src, cv::Mat &dst, FrameContext &) { return blurQuantize(src, dst, levels); };
+    } else if (name == "face") {
+        // detect on a reduced frame to avoid lag, then box the faces on a copy.
+        // The tracker runs the full cascade every `interval` frames and only
+        // searches around the known faces in between (interval=1: every frame).
+        // With async=1 detection runs on its own thread and the newest result
+        // is drawn, so the stage never waits for the cascade (unless the
+        // context is not realtime).
+        double scale = doubleParam(p, "scale", 0.5);
+        FaceTrackerParams trackParams = trackerParams(p);
+        if (intParam(p, "async", 0)) {
+            std::shared_ptr<AsyncFaceDetector> detector(new AsyncFaceDetector(scale, trackParams));
+            stage.run = [detector](cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+                updateFaces(*detector, src, ctx);
+                src.copyTo(dst);
+                for (size_t i = 0; i < ctx.faces.size(); i++) {
+                    cv::rectangle(dst, ctx.faces[i], cv::Scalar(0, 255, 0), 2);
+                }
+                return 0;
+            };
+            stage.reset = [detector]() { detector->reset(); };
+            return true;
+        }
+        std::shared_ptr<cv::Mat> small(new cv::Mat), grey(new cv::Mat);
+        std::shared_ptr<FaceTracker> tracker(new FaceTracker(trackParams));
+        stage.run = [scale, small, grey, tracker](cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+            cv::resize(src, *small, cv::Size(), scale, scale);
+            cv::cvtColor(*small, *grey, cv::COLOR_BGR2GRAY);
+            tracker->update(*grey, ctx.faces);
+
+            src.copyTo(dst);
+            for (size_t i = 0; i < ctx.faces.size(); i++) {
+                cv::Rect &face = ctx.faces[i];
+                face.x /= scale;
+                face.y /= scale;
+                face.width /= scale;
+                face.height /= scale;
+                cv::rectangle(dst, face, cv::Scalar(0, 255, 0), 2);
+            }
+            return 0;
+        };
+        stage.reset = [tracker]() { tracker->reset(); };
+    } else if (name == "negative") {
+        stage.planar = true;
+        stage.run = [](cv::Mat &src, cv::Mat &dst, FrameContext &) { return negativeFilter(src, dst); };
+    } else if (name == "emboss") {
+        stage.planar = true;
+        stage.run = [](cv::Mat &src, cv::Mat &dst, FrameContext &) { return embossEffect(src, dst); };
+    } else if (name == "colorfulFaces") {
+        // detect=1 keeps the faces current with a background detector;
+        // otherwise the faces already in the context are used
+        std::shared_ptr<AsyncFaceDetector> detector = faceSource(p);
+        if (detector) {
+            stage.run = [detector](cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+                updateFaces(*detector, src, ctx);
+                return colorfulFaces(src, ctx.faces, dst);
+            };
+            stage.reset = [detector]() { detector->reset(); };
+        } else {
+            stage.run = [](cv::Mat &src, cv::Mat &dst, FrameContext &ctx) { return colorfulFaces(src, ctx.faces, dst); };
+        }
+    } else if (name == "cartoon") {
+        int levels = intParam(p, "levels", 15);
+        int threshold = intParam(p, "threshold", 20);
+        stage.run = [levels, threshold](cv::Mat &src, cv::Mat &dst, FrameContext &) {
+            return cartoon(src, dst, levels, threshold);
+        };
+    } else if (name == "tone") {
+        // brightness / contrast as one table lookup, built once for the stage
+        std::shared_ptr<ToneAdjust> tone(new ToneAdjust);
+        tone->set((float)doubleParam(p, "brightness", 0.0), (float)doubleParam(p, "contrast", 1.0));
+        tone->setStretch(intParam(p, "stretch", 0) != 0);
+        stage.run = [tone](cv::Mat &src, cv::Mat &dst, FrameContext &) { return tone->apply(src, dst); };
+    } else if (name == "warp") {
+        // amp / freq in pixels; speed moves the wave by that many radians a frame
+        std::shared_ptr<WarpEngine> engine(new WarpEngine);
+        WarpParams warp;
+        warp.horizontal = p.count("dir") == 0 || p.find("dir")->second != "v";
+        warp.amplitude = doubleParam(p, "amp", warp.amplitude);
+        warp.frequency = doubleParam(p, "freq", warp.frequency);
+        warp.sampling = p.count("mode") && p.find("mode")->second == "bilinear" ? WARP_BILINEAR : WARP_NEAREST;
+        double speed = doubleParam(p, "speed", 0.0);
+        stage.run = [engine, warp, speed](cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+            WarpParams frameWarp = warp;
+            // the phase follows the frame number, so a replay animates the same way
+            frameWarp.phase = fmod(speed * ctx.frameIndex, 2 * M_PI);
+            return engine->apply(src, dst, frameWarp);
+        };
+    } else {
+        if (error) {
+            *error = "unknown filter stage \"" + name + "\"";
+        }
+        return false;
+    }
+    return true;
+}
+
+// proxy=N runs a stage at 1/N of the frame size and upsamples its result,
+// guided=1 edge-aware with the full frame as the guide. Stages that draw at
+// face positions work in full-frame coordinates and cannot be proxied.
+static bool makeProxy(FilterStage &stage, std::string *error) {
+    int factor = intParam(stage.params, "proxy", 1);
+    if (factor <= 1) {
+        return true;
+    }
+    if (isFaceStage(stage.name)) {
+        if (error) {
+            *error = "stage \"" + stage.name + "\" cannot run at proxy resolution";
+        }
+        return false;
+    }
+    ProxyParams params;
+    params.factor = factor;
+    params.guided = intParam(stage.params, "guided", 0) != 0;
+    std::shared_ptr<ProxyFilter> proxy(new ProxyFilter(params));
+    std::function<int(cv::Mat &, cv::Mat &, FrameContext &)> run = stage.run;
+    stage.run = [proxy, run](cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+        return proxy->apply(src, dst, [&run, &ctx](cv::Mat &s, cv::Mat &d) { return run(s, d, ctx); });
+    };
+    return true;
+}
+
+// roi=faces runs a stage only inside the faces of the context, roi=background
+// only outside them, with work in proportion to that area. margin=N grows the
+// faces, halo=N is how far the stage reads around a pixel (default 4) and
+// detect=1 finds the faces as colorfulFaces does. With proxy=N the background
+// is filtered at the reduced size in one go and the faces are put back.
+static bool makeRoi(FilterStage &stage, std::string *error) {
+    StageParams::const_iterator it = stage.params.find("roi");
+    if (it == stage.params.end()) {
+        return true;
+    }
+    if (it->second != "faces" && it->second != "background") {
+        if (error) {
+            *error = "roi of stage \"" + stage.name + "\" is \"" + it->second + "\", not faces or background";
+        }
+        return false;
+    }
+    // the face stages use the faces themselves, warp moves pixels further than
+    // any halo and depends on where the piece lies in the frame; the rest
+    // change the pixel type
+    bool excluded = isFaceStage(stage.name);
+    const char *names[] = {"warp", "gray", "sobelX", "sobelY"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        excluded = excluded || stage.name == names[i];
+    }
+    if (excluded) {
+        if (error) {
+            *error = "stage \"" + stage.name + "\" cannot run on a region of the frame";
+        }
+        return false;
+    }
+
+    RoiParams params;
+    params.mode = it->second == "faces" ? ROI_INSIDE : ROI_OUTSIDE;
+    params.margin = std::max(0, intParam(stage.params, "margin", params.margin));
+    params.halo = std::max(0, intParam(stage.params, "halo", params.halo));
+    params.wholeFrame = params.mode == ROI_OUTSIDE && intParam(stage.params, "proxy", 1) > 1;
+    std::shared_ptr<RoiFilter> roi(new RoiFilter(params));
+    std::shared_ptr<AsyncFaceDetector> detector = faceSource(stage.params);
+    std::function<int(cv::Mat &, cv::Mat &, FrameContext &)> run = stage.run;
+    stage.run = [roi, detector, run](cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+        if (detector) {
+            updateFaces(*detector, src, ctx);
+        }
+        return roi->apply(src, dst, ctx.faces, [&run, &ctx](cv::Mat &s, cv::Mat &d) { return run(s, d, ctx); });
+    };
+    if (detector) {
+        std::function<void()> reset = stage.reset;
+        stage.reset = [detector, reset]() {
+            detector->reset();
+            if (reset) {
+                reset();
+            }
+        };
+    }
+    return true;
+}
+
+std::vector<std::string> FilterPipeline::stageNames() {
+    const char *names[] = {"planar", "gray", "altgray", "sepia", "blur", "sobelX", "sobelY", "magnitude",
+                           "quantize", "face", "negative", "emboss", "colorfulFaces", "cartoon", "tone", "warp"};
+    return std::vector<std::string>(names, names + sizeof(names) / sizeof(names[0]));
+}
+
+bool FilterPipeline::parse(const std::string &spec, std::string *error) {
+    std::vector<FilterStage> stages;
+    std::stringstream chain(spec);
+    std::string item;
+    bool planar = false;
+
+    // stages are separated by '|', options follow a ':' as key=value pairs split by ','
+    while (std::getline(chain, item, '|')) {
+        item = trim(item);
+        if (item.empty()) {
+            continue;
+        }
+        if (item == "planar" && stages.empty() && !planar) {
+            planar = true;
+            continue;
+        }
+        FilterStage stage;
+        size_t colon = item.find(':');
+        stage.name = trim(item.substr(0, colon));
+        if (colon != std::string::npos) {
+            std::stringstream opts(item.substr(colon + 1));
+            std::string opt;
+            while (std::getline(opts, opt, ',')) {
+                size_t eq = opt.find('=');
+                if (eq == std::string::npos) {
+                    if (error) {
+                        *error = "option \"" + trim(opt) + "\" of stage \"" + stage.name + "\" is not key=value";
+                    }
+                    return false;
+                }
+                stage.params[trim(opt.substr(0, eq))] = trim(opt.substr(eq + 1));
+            }
+        }
+        if (!makeStage(stage, error) || !makeProxy(stage, error) || !makeRoi(stage, error)) {
+            return false;
+        }
+        if (planar && !stage.planar) {
+            if (error) {
+                *error = "stage \"" + stage.name + "\" cannot run on planes";
+            }
+            return false;
+        }
+        stage.timer = &profileStage("stage " + stage.name);
+        stages.push_back(stage);
+    }
+
+    stages_.swap(stages);
+    spec_ = spec;
+    planar_ = planar;
+    return true;
+}
+
+int FilterPipeline::process(cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+    if (src.empty()) {
+        return -1;
+    }
+    if (stages_.empty()) {
+        dst = src;
+        return 0;
+    }
+
+    if (planar_) {
+        return processPlanes(src, dst, ctx);
+    }
+
+    // stage i reads the previous output and writes buffers_[i % 2]; the
+    // buffers keep their memory, so filters calling create() reuse it
+    cv::Mat *in = &src;
+    for (size_t i = 0; i < stages_.size(); i++) {
+        cv::Mat *out = &buffers_[i % 2];
+        ScopedTimer timer(*stages_[i].timer);
+        if (stages_[i].run(*in, *out, ctx) != 0) {
+            return -1;
+        }
+        in = out;
+    }
+    dst = *in;
+    return 0;
+}
+
+void FilterPipeline::reset() {
+    for (size_t i = 0; i < stages_.size(); i++) {
+        if (stages_[i].reset) {
+            stages_[i].reset();
+        }
+    }
+}
+
+// The same chain on one plane per channel: split on entry, merge on exit, and
+// every stage runs its single-channel path in between.
+int FilterPipeline::processPlanes(cv::Mat &src, cv::Mat &dst, FrameContext &ctx) {
+    cv::split(src, planes_[0]);
+    std::vector<cv::Mat> *in = &planes_[0];
+    for (size_t i = 0; i < stages_.size(); i++) {
+        std::vector<cv::Mat> *out = &planes_[(i + 1) % 2];
+        out->resize(in->size());
+        ScopedTimer timer(*stages_[i].timer);
+        for (size_t c = 0; c < in->size(); c++) {
+            if (stages_[i].run((*in)[c], (*out)[c], ctx) != 0) {
+                return -1;
+            }
+        }
+        in = out;
+    }
+    cv::merge(*in, buffers_[0]);
+    dst = buffers_[0];
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file profiler.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief scoped stage timers with per-stage histograms, an overlay and CSV / JSON dumps
+ * @version 0.1
+ * @date 2024-03-03
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include "profiler.h"
+
+std::atomic<bool> profilingOn(false);
+
+void setProfiling(bool on) {
+    profilingOn.store(on, std::memory_order_relaxed);
+}
+
+void StageHistogram::record(double ms) {
+    long long us = std::max(0LL, (long long)(ms * 1000.0 + 0.5));
+    int b = us <= 1 ? 0 : std::min(kBuckets - 1, (int)(4.0 * std::log2((double)us)));
+
+    buckets_[b].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    totalUs_.fetch_add(us, std::memory_order_relaxed);
+    long long prev = maxUs_.load(std::memory_order_relaxed);
+    while (us > prev && !maxUs_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+    }
+}
+
+void StageHistogram::reset() {
+    for (int i = 0; i < kBuckets; i++) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    totalUs_.store(0, std::memory_order_relaxed);
+    maxUs_.store(0, std::memory_order_relaxed);
+}
+
+double StageHistogram::percentileMs(double q) const {
+    long long n = count();
+    if (n == 0) {
+        return 0.0;
+    }
+    long long rank = std::max(1LL, (long long)std::ceil(q * n));
+    long long seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // the geometric middle of the bucket, but never more than the largest sample
+            return std::min(std::pow(2.0, (i + 0.5) / 4.0), (double)maxUs_.load(std::memory_order_relaxed)) / 1000.0;
+        }
+    }
+    return maxMs();
+}
+
+// every histogram ever asked for; they live until the program exits
+static std::mutex registryLock;
+static std::vector<StageHistogram *> &registry() {
+    static std::vector<StageHistogram *> stages;
+    return stages;
+}
+
+StageHistogram &profileStage(const std::string &name) {
+    static std::map<std::string, StageHistogram *> byName;
+    std::lock_guard<std::mutex> guard(registryLock);
+    std::map<std::string, StageHistogram *>::iterator it = byName.find(name);
+    if (it != byName.end()) {
+        return *it->second;
+    }
+    StageHistogram *stage = new StageHistogram(name);
+    byName[name] = stage;
+    registry().push_back(stage);
+    return *stage;
+}
+
+std::vector<StageSummary> profileSummary() {
+    std::vector<StageSummary> summary;
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (size_t i = 0; i < registry().size(); i++) {
+        const StageHistogram &h = *registry()[i];
+        long long n = h.count();
+        if (n == 0) {
+            continue;
+        }
+        StageSummary s;
+        s.name = h.name();
+        s.count = n;
+        s.meanMs = h.totalMs() / n;
+        s.p50Ms = h.percentileMs(0.50);
+        s.p95Ms = h.percentileMs(0.95);
+        s.p99Ms = h.percentileMs(0.99);
+        s.maxMs = h.maxMs();
+        summary.push_back(s);
+    }
+    return summary;
+}
+
+void resetProfile() {
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (size_t i = 0; i < registry().size(); i++) {
+        registry()[i]->reset();
+    }
+}
+
+int writeProfile(const std::string &path) {
+    std::vector<StageSummary> summary = profileSummary();
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out) {
+        return -1;
+    }
+    if (csv) {
+        fprintf(out, "stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+        for (size_t i = 0; i < summary.size(); i++) {
+            const StageSummary &s = summary[i];
+            fprintf(out, "%s,%lld,%.4f,%.4f,%.4f,%.4f,%.4f\n", s.name.c_str(), s.count, s.meanMs,
+                    s.p50Ms, s.p95Ms, s.p99Ms, s.maxMs);
+        }
+    } else {
+        fprintf(out, "{\n  \"stages\": [\n");
+        for (size_t i = 0; i < summary.size(); i++) {
+            const StageSummary &s = summary[i];
+            fprintf(out, "    {\"stage\": \"%s\", \"count\": %lld, \"mean_ms\": %.4f, \"p50_ms\": %.4f, "
+                         "\"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}%s\n",
+                    s.name.c_str(), s.count, s.meanMs, s.p50Ms, s.p95Ms, s.p99Ms, s.maxMs,
+                    i + 1 < summary.size() ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+    }
+    fclose(out);
+    return 0;
+}
+
+void drawProfileOverlay(cv::Mat &frame, double fps) {
+    if (frame.empty()) {
+        return;
+    }
+    std::vector<std::string> lines;
+    char text[128];
+    snprintf(text, sizeof(text), "%.1f fps", fps);
+    lines.push_back(text);
+
+    std::vector<StageSummary> summary = profileSummary();
+    for (size_t i = 0; i < summary.size(); i++) {
+        const StageSummary &s = summary[i];
+        snprintf(text, sizeof(text), "%-14s %6.2f ms  p95 %6.2f", s.name.c_str(), s.meanMs, s.p95Ms);
+        lines.push_back(text);
+    }
+
+    // a dark box behind the text keeps it readable on bright frames
+    int lineHeight = 18;
+    cv::Rect box(0, 0, std::min(frame.cols, 330), std::min(frame.rows, lineHeight * (int)lines.size() + 8));
+    cv::Mat background = frame(box);
+    background *= 0.4;
+    cv::Scalar colour = frame.channels() == 1 ? cv::Scalar(255) : cv::Scalar(0, 255, 0);
+    for (size_t i = 0; i < lines.size(); i++) {
+        cv::putText(frame, lines[i], cv::Point(6, lineHeight * (int)(i + 1)), cv::FONT_HERSHEY_PLAIN, 1.0,
+                    colour, 1, cv::LINE_AA);
+    }
+}
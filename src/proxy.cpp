@@ -0,0 +1,192 @@
+/**
+ * @file proxy.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief run a filter at reduced resolution and upsample its result
+ * @version 0.1
+ * @date 2024-03-08
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include "proxy.h"
+#include "parallel.h"
+#include "profiler.h"
+
+// Mean over the (2r + 1) x (2r + 1) window around every value of a w x h
+// image with cn interleaved channels. Windows are clamped at the image edge,
+// i.e. the edge values are repeated.
+static void boxMean(std::vector<float> &data, std::vector<float> &tmp, int w, int h, int cn, int r) {
+    tmp.resize(data.size());
+    const float norm = 1.0f / ((2 * r + 1) * (2 * r + 1));
+    const int stride = w * cn;
+
+    parallelRows(0, h, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const float *s = &data[(size_t)y * stride];
+            float *t = &tmp[(size_t)y * stride];
+            for (int x = 0; x < w; x++) {
+                for (int c = 0; c < cn; c++) {
+                    float sum = 0.0f;
+                    for (int dx = -r; dx <= r; dx++) {
+                        sum += s[std::min(w - 1, std::max(0, x + dx)) * cn + c];
+                    }
+                    t[x * cn + c] = sum;
+                }
+            }
+        }
+    });
+    parallelRows(0, h, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            float *d = &data[(size_t)y * stride];
+            for (int i = 0; i < stride; i++) {
+                d[i] = 0.0f;
+            }
+            for (int dy = -r; dy <= r; dy++) {
+                const float *t = &tmp[(size_t)std::min(h - 1, std::max(0, y + dy)) * stride];
+                for (int i = 0; i < stride; i++) {
+                    d[i] += t[i];
+                }
+            }
+            for (int i = 0; i < stride; i++) {
+                d[i] *= norm;
+            }
+        }
+    });
+}
+
+// a and b of out = a * in + b per channel, least squares over each window of
+// the proxy input and output, then averaged over the windows covering a pixel
+void ProxyFilter::fitLinearModel() {
+    const int w = small_.cols, h = small_.rows, cn = small_.channels();
+    const size_t n = (size_t)w * h * cn;
+    a_.resize(n);
+    b_.resize(n);
+    ii_.resize(n);
+    ip_.resize(n);
+
+    for (int y = 0; y < h; y++) {
+        const uchar *in = small_.ptr<uchar>(y);
+        const uchar *out = smallOut_.ptr<uchar>(y);
+        size_t base = (size_t)y * w * cn;
+        for (int i = 0; i < w * cn; i++) {
+            float I = in[i], p = out[i];
+            a_[base + i] = I;
+            b_[base + i] = p;
+            ii_[base + i] = I * I;
+            ip_[base + i] = I * p;
+        }
+    }
+    const int r = params_.radius;
+    boxMean(a_, tmp_, w, h, cn, r);
+    boxMean(b_, tmp_, w, h, cn, r);
+    boxMean(ii_, tmp_, w, h, cn, r);
+    boxMean(ip_, tmp_, w, h, cn, r);
+
+    for (size_t i = 0; i < n; i++) {
+        float meanI = a_[i], meanP = b_[i];
+        float a = (ip_[i] - meanI * meanP) / (ii_[i] - meanI * meanI + params_.eps);
+        a_[i] = a;
+        b_[i] = meanP - a * meanI;
+    }
+    boxMean(a_, tmp_, w, h, cn, r);
+    boxMean(b_, tmp_, w, h, cn, r);
+}
+
+// out = a * guide + b at full size, with a and b interpolated bilinearly
+void ProxyFilter::guidedUpsample(const cv::Mat &guide, cv::Mat &dst) {
+    fitLinearModel();
+
+    const int W = guide.cols, H = guide.rows;
+    const int w = small_.cols, h = small_.rows, cn = small_.channels();
+    dst.create(guide.size(), guide.type());
+
+    // pixel centres line up as in cv::resize
+    x0_.resize(W);
+    x1_.resize(W);
+    wx_.resize(W);
+    for (int x = 0; x < W; x++) {
+        float sx = (x + 0.5f) * w / W - 0.5f;
+        int x0 = cvFloor(sx);
+        float wx = sx - x0;
+        if (x0 < 0) {
+            x0 = 0;
+            wx = 0.0f;
+        }
+        if (x0 >= w - 1) {
+            x0 = w - 1;
+            wx = 0.0f;
+        }
+        x0_[x] = x0 * cn;
+        x1_[x] = std::min(x0 + 1, w - 1) * cn;
+        wx_[x] = wx;
+    }
+
+    parallelRows(0, H, [&](int y0, int y1) {
+        // a and b of the proxy rows above and below, blended for this row
+        static thread_local std::vector<float> rowA, rowB;
+        rowA.resize((size_t)w * cn);
+        rowB.resize((size_t)w * cn);
+
+        for (int y = y0; y < y1; y++) {
+            float sy = (y + 0.5f) * h / H - 0.5f;
+            int r0 = cvFloor(sy);
+            float wy = sy - r0;
+            if (r0 < 0) {
+                r0 = 0;
+                wy = 0.0f;
+            }
+            if (r0 >= h - 1) {
+                r0 = h - 1;
+                wy = 0.0f;
+            }
+            int r1 = std::min(r0 + 1, h - 1);
+            const float *a0 = &a_[(size_t)r0 * w * cn], *a1 = &a_[(size_t)r1 * w * cn];
+            const float *b0 = &b_[(size_t)r0 * w * cn], *b1 = &b_[(size_t)r1 * w * cn];
+            for (int i = 0; i < w * cn; i++) {
+                rowA[i] = a0[i] + wy * (a1[i] - a0[i]);
+                rowB[i] = b0[i] + wy * (b1[i] - b0[i]);
+            }
+
+            const uchar *g = guide.ptr<uchar>(y);
+            uchar *d = dst.ptr<uchar>(y);
+            for (int x = 0; x < W; x++) {
+                const int i0 = x0_[x], i1 = x1_[x];
+                const float wx = wx_[x];
+                for (int c = 0; c < cn; c++) {
+                    float A = rowA[i0 + c] + wx * (rowA[i1 + c] - rowA[i0 + c]);
+                    float B = rowB[i0 + c] + wx * (rowB[i1 + c] - rowB[i0 + c]);
+                    d[x * cn + c] = cv::saturate_cast<uchar>(A * g[x * cn + c] + B);
+                }
+            }
+        }
+    });
+}
+
+int ProxyFilter::apply(cv::Mat &src, cv::Mat &dst, const ProxyFilterFn &filter) {
+    if (src.empty()) {
+        return -1;
+    }
+    const int f = std::max(1, params_.factor);
+    cv::Size size((src.cols + f - 1) / f, (src.rows + f - 1) / f);
+    if (size == src.size()) {
+        return filter(src, dst);
+    }
+
+    {
+        PROFILE_SCOPE("proxy down");
+        cv::resize(src, small_, size, 0, 0, cv::INTER_AREA);
+    }
+    int ret = filter(small_, smallOut_);
+    if (ret != 0) {
+        return ret;
+    }
+
+    PROFILE_SCOPE("proxy up");
+    if (params_.guided && src.depth() == CV_8U && smallOut_.type() == small_.type()) {
+        guidedUpsample(src, dst);
+    } else {
+        cv::resize(smallOut_, dst, src.size(), 0, 0, cv::INTER_LINEAR);
+    }
+    return 0;
+}
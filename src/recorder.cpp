@@ -0,0 +1,250 @@
+/**
+ * @file recorder.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief video recording on a background thread, with a choice of codecs
+ * @version 0.1
+ * @date 2024-03-09
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "recorder.h"
+#include "profiler.h"
+
+// the frame rate is measured over this many frames or this many seconds,
+// whichever comes first, before the file is opened
+static const size_t kPrerollFrames = 15;
+static const double kPrerollSeconds = 1.0;
+
+struct CodecInfo {
+    const char *name;
+    const char *extension;
+    const char *fourccs[3]; // tried in order, NULL-terminated when shorter
+};
+
+static const CodecInfo codecs[] = {
+    {"mjpg", "avi", {"MJPG", NULL, NULL}},
+    // OpenCV's FFmpeg builds know H.264 as avc1, H264 or X264 depending on the encoder they carry
+    {"h264", "mp4", {"avc1", "H264", "X264"}},
+    {"ffv1", "mkv", {"FFV1", NULL, NULL}},
+};
+
+bool parseRecordCodec(const std::string &name, RecordCodec &codec) {
+    for (int i = 0; i < (int)(sizeof(codecs) / sizeof(codecs[0])); i++) {
+        if (name == codecs[i].name) {
+            codec = (RecordCodec)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *recordExtension(RecordCodec codec) {
+    return codecs[codec].extension;
+}
+
+bool openVideoWriter(cv::VideoWriter &writer, const std::string &path, RecordCodec codec,
+                     double fps, cv::Size size, bool isColor, std::string *fourcc) {
+    const int apis[] = {cv::CAP_FFMPEG, cv::CAP_ANY};
+    for (int a = 0; a < 2; a++) {
+        for (int i = 0; i < 3 && codecs[codec].fourccs[i]; i++) {
+            const char *cc = codecs[codec].fourccs[i];
+            if (writer.open(path, apis[a], cv::VideoWriter::fourcc(cc[0], cc[1], cc[2], cc[3]), fps, size, isColor)) {
+                if (fourcc) {
+                    *fourcc = cc;
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+AsyncRecorder::AsyncRecorder(size_t queueSize)
+    : queue_(queueSize), free_(queueSize * 2), state_(IDLE), codec_(RECORD_MJPG), stop_(false),
+      failed_(false) {
+    worker_ = std::thread(&AsyncRecorder::run, this);
+}
+
+AsyncRecorder::~AsyncRecorder() {
+    stop();
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stop_ = true;
+    }
+    ready_.notify_one();
+    worker_.join();
+}
+
+bool AsyncRecorder::start(const std::string &path, RecordCodec codec, double fps) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (state_ != IDLE) {
+        return false;
+    }
+    stats_ = RecorderStats();
+    stats_.path = path;
+    stats_.fps = fps;
+    codec_ = codec;
+    state_ = RECORDING;
+    return true;
+}
+
+RecorderStats AsyncRecorder::stop() {
+    std::unique_lock<std::mutex> guard(lock_);
+    if (state_ == RECORDING) {
+        state_ = CLOSING;
+        ready_.notify_one();
+    }
+    while (state_ != IDLE) {
+        closed_.wait(guard);
+    }
+    return stats_;
+}
+
+void AsyncRecorder::push(const cv::Mat &frame, long long index, double timestamp, cv::Size size) {
+    if (state_ != RECORDING || frame.empty()) {
+        return;
+    }
+    Frame f;
+    f.index = index;
+    f.timestamp = timestamp;
+    free_.tryPop(f.image);
+    if (size.area() == 0 || size == frame.size()) {
+        frame.copyTo(f.image);
+    } else {
+        cv::resize(frame, f.image, size, 0, 0, size.area() < frame.size().area() ? cv::INTER_AREA : cv::INTER_LINEAR);
+    }
+
+    Frame evicted;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (state_ != RECORDING) {
+            return;
+        }
+        if (queue_.pushDropOldest(f, evicted)) {
+            stats_.dropped++;
+        }
+    }
+    ready_.notify_one();
+    if (!evicted.image.empty()) {
+        free_.tryPush(evicted.image);
+    }
+}
+
+void AsyncRecorder::run() {
+    for (;;) {
+        Frame f;
+        if (queue_.tryPop(f)) {
+            encode(f);
+            continue;
+        }
+
+        // push() enqueues under lock_, so a queue that is empty here stays
+        // empty until its notify: no frame is missed and no timeout is needed
+        std::unique_lock<std::mutex> guard(lock_);
+        if (queue_.tryPop(f)) {
+            guard.unlock();
+            encode(f);
+            continue;
+        }
+        if (state_ == CLOSING) {
+            // nothing is pushed once closing, so the queue stays empty
+            guard.unlock();
+            finish();
+            guard.lock();
+            state_ = IDLE;
+            closed_.notify_all();
+            continue;
+        }
+        if (stop_) {
+            return;
+        }
+        ready_.wait(guard);
+    }
+}
+
+// hold frames back until the frame rate is known, then write them in order
+void AsyncRecorder::encode(Frame &f) {
+    if (failed_) {
+        free_.tryPush(f.image);
+        return;
+    }
+    if (!writer_.isOpened()) {
+        preroll_.push_back(Frame());
+        std::swap(preroll_.back(), f);
+        double span = preroll_.back().timestamp - preroll_.front().timestamp;
+        if (stats_.fps <= 0 && preroll_.size() < kPrerollFrames && span < kPrerollSeconds) {
+            return;
+        }
+        if (!openFile()) {
+            failed_ = true;
+            preroll_.clear();
+            return;
+        }
+        for (size_t i = 0; i < preroll_.size(); i++) {
+            writeFrame(preroll_[i].image);
+            free_.tryPush(preroll_[i].image);
+        }
+        preroll_.clear();
+        return;
+    }
+    writeFrame(f.image);
+    free_.tryPush(f.image);
+}
+
+// Opens the file in the format of the first held-back frame. The stats fields
+// set here and in writeFrame() belong to the encoder thread while recording;
+// push() only touches dropped, and stop() reads them after closing.
+bool AsyncRecorder::openFile() {
+    const cv::Mat &first = preroll_.front().image;
+    double fps = stats_.fps;
+    if (fps <= 0) {
+        double span = preroll_.back().timestamp - preroll_.front().timestamp;
+        fps = preroll_.size() > 1 && span > 0 ? (preroll_.size() - 1) / span : 30.0;
+        fps = std::min(120.0, std::max(1.0, fps));
+    }
+
+    std::string fourcc;
+    if (!openVideoWriter(writer_, stats_.path, codec_, fps, first.size(), first.channels() != 1, &fourcc)) {
+        std::cerr << "Could not open " << stats_.path << " for write\n";
+        return false;
+    }
+    stats_.fourcc = fourcc;
+    stats_.size = first.size();
+    stats_.channels = first.channels() == 1 ? 1 : 3;
+    stats_.fps = fps;
+    return true;
+}
+
+// write image, converted to the size and channel count of the file if needed
+void AsyncRecorder::writeFrame(const cv::Mat &image) {
+    PROFILE_SCOPE("record");
+    const cv::Mat *out = &image;
+    if (image.channels() != stats_.channels) {
+        cv::cvtColor(*out, converted_, stats_.channels == 1 ? cv::COLOR_BGR2GRAY : cv::COLOR_GRAY2BGR);
+        out = &converted_;
+    }
+    if (out->size() != stats_.size) {
+        cv::resize(*out, resized_, stats_.size, 0, 0, cv::INTER_LINEAR);
+        out = &resized_;
+    }
+    writer_.write(*out);
+    stats_.written++;
+}
+
+// a recording shorter than the measuring window is written with what was measured
+void AsyncRecorder::finish() {
+    if (!preroll_.empty()) {
+        if (openFile()) {
+            for (size_t i = 0; i < preroll_.size(); i++) {
+                writeFrame(preroll_[i].image);
+                free_.tryPush(preroll_[i].image);
+            }
+        }
+        preroll_.clear();
+    }
+    writer_.release();
+    failed_ = false;
+}
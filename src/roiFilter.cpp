@@ -0,0 +1,155 @@
+/**
+ * @file roiFilter.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief run a filter only inside or only outside a list of rectangles
+ * @version 0.1
+ * @date 2024-03-12
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <utility>
+#include "roiFilter.h"
+#include "profiler.h"
+
+static cv::Rect grow(const cv::Rect &r, int n) {
+    return cv::Rect(r.x - n, r.y - n, r.width + 2 * n, r.height + 2 * n);
+}
+
+// append piece to pieces, or join it to the piece right above it when that
+// one has the same columns
+static void addPiece(std::vector<cv::Rect> &pieces, const cv::Rect &piece) {
+    for (size_t p = 0; p < pieces.size(); p++) {
+        cv::Rect &above = pieces[p];
+        if (above.x == piece.x && above.width == piece.width && above.y + above.height == piece.y) {
+            above.height += piece.height;
+            return;
+        }
+    }
+    pieces.push_back(piece);
+}
+
+// The rectangles (grown by the margin and clipped to the frame) and the rest
+// of the frame, each as disjoint rectangles. The rectangle edges cut the
+// frame into horizontal bands; every rectangle covers a band entirely or not
+// at all, so in each band the covered columns are the union of a few spans
+// and the gaps between them are the outside.
+void RoiFilter::cutPieces(const std::vector<cv::Rect> &rects, cv::Size size) {
+    const cv::Rect frame(0, 0, size.width, size.height);
+    regions_.clear();
+    outside_.clear();
+    grown_.clear();
+    std::vector<int> ys;
+    ys.push_back(0);
+    ys.push_back(size.height);
+    for (size_t i = 0; i < rects.size(); i++) {
+        cv::Rect r = grow(rects[i], std::max(0, params_.margin)) & frame;
+        if (r.area() > 0) {
+            grown_.push_back(r);
+            ys.push_back(r.y);
+            ys.push_back(r.y + r.height);
+        }
+    }
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    for (size_t k = 0; k + 1 < ys.size(); k++) {
+        const int y0 = ys[k], h = ys[k + 1] - y0;
+        spans_.clear();
+        for (size_t i = 0; i < grown_.size(); i++) {
+            const cv::Rect &r = grown_[i];
+            if (r.y <= y0 && y0 < r.y + r.height) {
+                spans_.push_back(std::make_pair(r.x, r.x + r.width));
+            }
+        }
+        std::sort(spans_.begin(), spans_.end());
+
+        int x = 0;
+        for (size_t s = 0; s < spans_.size();) {
+            // overlapping spans become one
+            int begin = spans_[s].first, end = spans_[s].second;
+            for (s++; s < spans_.size() && spans_[s].first <= end; s++) {
+                end = std::max(end, spans_[s].second);
+            }
+            if (begin > x) {
+                addPiece(outside_, cv::Rect(x, y0, begin - x, h));
+            }
+            addPiece(regions_, cv::Rect(begin, y0, end - begin, h));
+            x = end;
+        }
+        if (x < size.width) {
+            addPiece(outside_, cv::Rect(x, y0, size.width - x, h));
+        }
+    }
+}
+
+int RoiFilter::apply(cv::Mat &src, cv::Mat &dst, const std::vector<cv::Rect> &rects, const RoiFilterFn &filter) {
+    if (src.empty()) {
+        return -1;
+    }
+    const cv::Rect frame(0, 0, src.cols, src.rows);
+    const bool inPlace = dst.data == src.data;
+    cutPieces(rects, src.size());
+
+    if (params_.mode == ROI_OUTSIDE && params_.wholeFrame) {
+        pieces_.assign(1, frame);
+        outs_.resize(1);
+        cv::Mat &out = inPlace ? outs_[0] : dst;
+        int ret = filter(src, out);
+        if (ret != 0) {
+            return ret;
+        }
+        if (out.type() != src.type() || out.size() != src.size()) {
+            return -1;
+        }
+        PROFILE_SCOPE("roi paste");
+        for (size_t i = 0; i < regions_.size(); i++) {
+            src(regions_[i]).copyTo(out(regions_[i]));
+        }
+        if (inPlace) {
+            out.copyTo(dst);
+        }
+        return 0;
+    }
+
+    pieces_ = params_.mode == ROI_INSIDE ? regions_ : outside_;
+    // nothing to leave out: the filter can write dst itself
+    if (!inPlace && pieces_.size() == 1 && pieces_[0] == frame) {
+        int ret = filter(src, dst);
+        return ret != 0 ? ret : (dst.type() == src.type() && dst.size() == src.size() ? 0 : -1);
+    }
+
+    // filter every piece before any is written back: in place, the halo of
+    // a later piece must still hold source pixels
+    const int halo = std::max(0, params_.halo);
+    outs_.resize(pieces_.size());
+    for (size_t i = 0; i < pieces_.size(); i++) {
+        cv::Rect window = grow(pieces_[i], halo) & frame;
+        cv::Mat in = src(window);
+        int ret = filter(in, outs_[i]);
+        if (ret != 0) {
+            return ret;
+        }
+        if (outs_[i].type() != src.type() || outs_[i].size() != window.size()) {
+            return -1;
+        }
+    }
+
+    PROFILE_SCOPE("roi paste");
+    if (!inPlace) {
+        dst.create(src.size(), src.type());
+        if (params_.mode == ROI_INSIDE) {
+            src.copyTo(dst);
+        } else {
+            for (size_t i = 0; i < regions_.size(); i++) {
+                src(regions_[i]).copyTo(dst(regions_[i]));
+            }
+        }
+    }
+    for (size_t i = 0; i < pieces_.size(); i++) {
+        cv::Rect window = grow(pieces_[i], halo) & frame;
+        cv::Rect inner(pieces_[i].x - window.x, pieces_[i].y - window.y, pieces_[i].width, pieces_[i].height);
+        outs_[i](inner).copyTo(dst(pieces_[i]));
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file serveStreams.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief filter several cameras / video files at once and report per-stream rates
+ * @version 0.1
+ * @date 2024-03-10
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+#include "pipeline.h"
+#include "framePool.h"
+#include "profiler.h"
+#include "streamServer.h"
+
+static void usage(const char *prog) {
+    printf("Usage: %s -s <device | video>[@<filter spec>] [-s ...] [-p <default filter spec>]\n", prog);
+    printf("          [-w <workers>] [-t <threads per filter>] [-d <seconds>] [-r <report interval s>]\n");
+    printf("          [-l] [-f] [-S] [-P <stage timings .csv | .json>]\n");
+    printf("  -l starts files over at their end, -f reads files as fast as possible instead of\n");
+    printf("  at their frame rate, -S shows every stream in a window ('q' quits)\n");
+    printf("  e.g. %s -s a.mp4@sepia -s b.mp4@\"face:async=0\" -s 0 -p blur -w 4\n", prog);
+}
+
+static double now() {
+    return cv::getTickCount() / cv::getTickFrequency();
+}
+
+static void printStats(const std::vector<StreamStats> &stats) {
+    printf("stream    fps   frames  dropped  failed  p50 ms  p95 ms  max ms  source\n");
+    for (size_t i = 0; i < stats.size(); i++) {
+        const StreamStats &s = stats[i];
+        printf("%6d %6.1f %8lld %8lld %7lld %7.1f %7.1f %7.1f  %s%s\n", s.id, s.fps, s.frames, s.dropped,
+               s.failed, s.latencyP50Ms, s.latencyP95Ms, s.latencyMaxMs, s.source.c_str(), s.ended ? " (ended)" : "");
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    // frames of the same size reuse pooled buffers instead of the heap
+    installFramePool();
+    std::vector<std::string> sources;
+    std::string defaultSpec, profilePath;
+    int workers = 0, filterThreads = -1;
+    double duration = 0.0, reportInterval = 2.0;
+    bool loop = false, pace = true, show = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-l") {
+            loop = true;
+        } else if (arg == "-f") {
+            pace = false;
+        } else if (arg == "-S") {
+            show = true;
+        } else if (i + 1 < argc && arg == "-s") {
+            sources.push_back(argv[++i]);
+        } else if (i + 1 < argc && arg == "-p") {
+            defaultSpec = argv[++i];
+        } else if (i + 1 < argc && arg == "-w") {
+            workers = atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "-t") {
+            filterThreads = atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "-d") {
+            duration = atof(argv[++i]);
+        } else if (i + 1 < argc && arg == "-r") {
+            reportInterval = std::max(0.1, atof(argv[++i]));
+        } else if (i + 1 < argc && arg == "-P") {
+            profilePath = argv[++i];
+            setProfiling(true);
+        } else {
+            usage(argv[0]);
+            return(-1);
+        }
+    }
+    if (sources.empty()) {
+        usage(argv[0]);
+        return(-1);
+    }
+
+    // one worker per stream up to the core count; the filters get the cores left per worker
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    if (workers <= 0) {
+        workers = std::min(cores, (int)sources.size());
+    }
+    setFilterThreads(filterThreads >= 0 ? filterThreads : std::max(1, cores / workers));
+
+    StreamServer server(workers, show);
+    for (size_t i = 0; i < sources.size(); i++) {
+        // "clip.mp4@sepia|blur" gives the stream its own chain
+        StreamConfig config;
+        size_t at = sources[i].find('@');
+        config.source = sources[i].substr(0, at);
+        config.spec = at == std::string::npos ? defaultSpec : sources[i].substr(at + 1);
+        config.loop = loop;
+        config.pace = pace;
+        std::string error;
+        if (server.addStream(config, &error) < 0) {
+            printf("Stream %s: %s\n", sources[i].c_str(), error.c_str());
+            return(-1);
+        }
+    }
+
+    server.start();
+    printf("%d streams on %d workers, %d threads per filter\n", (int)server.streamCount(), server.workerCount(),
+           getFilterThreads());
+
+    double start = now(), lastReport = start;
+    cv::Mat frame;
+    while (!server.finished() && (duration <= 0 || now() - start < duration)) {
+        if (show) {
+            // highgui wants the windows on the main thread
+            for (int id = 0; id < (int)server.streamCount(); id++) {
+                if (server.latest(id, frame)) {
+                    cv::imshow("stream " + std::to_string(id), frame);
+                }
+            }
+            if (cv::waitKey(10) == 'q') {
+                break;
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        if (now() - lastReport >= reportInterval) {
+            lastReport = now();
+            printStats(server.stats());
+        }
+    }
+
+    server.stop();
+    printf("Final, over the last %.1f s:\n", now() - lastReport);
+    printStats(server.stats());
+    printPoolStats(framePool()->stats());
+    if (!profilePath.empty() && writeProfile(profilePath) != 0) {
+        printf("Unable to write %s\n", profilePath.c_str());
+    }
+    return(0);
+}
@@ -10,6 +10,7 @@
 #include <cstdlib>
 #include <opencv2/opencv.hpp>
 #include "faceDetect.h"
+#include "faceTrack.h"
 
 int main(int argc, char *argv[]) {
   cv::VideoCapture *capdev;
@@ -32,7 +33,9 @@ int main(int argc, char *argv[]) {
   cv::Mat frame;
   cv::Mat grey;
   std::vector<cv::Rect> faces;
-  cv::Rect last(0, 0, 0, 0);
+
+  // full detection every few frames, cheap region searches and smoothing in between
+  FaceTracker tracker;
 
   // Loop forever
   for(int f=0;;f++) {
@@ -48,20 +51,12 @@ int main(int argc, char *argv[]) {
     // convert the image to greyscale
     cv::cvtColor( frame, grey, cv::COLOR_BGR2GRAY, 0);
 
-    // detect faces
-    detectFaces( grey, faces );
+    // detect / track faces; each face is smoothed by its own alpha-beta filter
+    tracker.update( grey, faces );
 
     // draw boxes around the faces
     drawBoxes( frame, faces );
 
-    // add a little smoothing by averaging the last two detections
-    if( faces.size() > 0 ) {
-      last.x = (faces[0].x + last.x)/2;
-      last.y = (faces[0].y + last.y)/2;
-      last.width = (faces[0].width + last.width)/2;
-      last.height = (faces[0].height + last.height)/2;
-    }
-
     // display the frame with the box in it
     cv::imshow("Video", frame);
     
@@ -0,0 +1,256 @@
+/**
+ * @file streamServer.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief many cameras / video files filtered at once over a shared worker pool
+ * @version 0.1
+ * @date 2024-03-10
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include "streamServer.h"
+
+static double now() {
+    return cv::getTickCount() / cv::getTickFrequency();
+}
+
+// how long an idle thread waits before looking at the queues again
+static void idle() {
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+}
+
+static bool isDeviceIndex(const std::string &source) {
+    if (source.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < source.size(); i++) {
+        if (!isdigit((unsigned char)source[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+StreamServer::StreamServer(int workers, bool keepLatest)
+    : workerCount_(workers), keepLatest_(keepLatest), running_(false), next_(0), lastReport_(now()) {}
+
+StreamServer::~StreamServer() {
+    stop();
+}
+
+int StreamServer::addStream(const StreamConfig &config, std::string *error) {
+    std::unique_ptr<Stream> s(new Stream());
+    s->id = (int)streams_.size();
+    s->config = config;
+    if (!s->pipeline.parse(config.spec, error)) {
+        return -1;
+    }
+
+    bool device = isDeviceIndex(config.source);
+    if (device) {
+        s->capture.open(atoi(config.source.c_str()));
+    } else {
+        s->capture.open(config.source);
+    }
+    if (!s->capture.isOpened()) {
+        if (error) {
+            *error = "unable to open " + config.source;
+        }
+        return -1;
+    }
+    // a camera delivers at its own pace already
+    s->config.pace = config.pace && !device;
+    s->config.loop = config.loop && !device;
+    s->live = device || s->config.pace;
+    s->sourceFps = s->capture.get(cv::CAP_PROP_FPS);
+    if (s->sourceFps <= 0) {
+        s->sourceFps = 30.0;
+    }
+
+    streams_.push_back(std::move(s));
+    return streams_.back()->id;
+}
+
+void StreamServer::start() {
+    if (running_ || streams_.empty()) {
+        return;
+    }
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    if (workerCount_ <= 0) {
+        workerCount_ = std::min(cores, (int)streams_.size());
+    }
+    running_ = true;
+    lastReport_ = now();
+    for (size_t i = 0; i < streams_.size(); i++) {
+        streams_[i]->reader = std::thread(&StreamServer::readLoop, this, streams_[i].get());
+    }
+    for (int w = 0; w < workerCount_; w++) {
+        workers_.push_back(std::thread(&StreamServer::workLoop, this));
+    }
+}
+
+void StreamServer::stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    for (size_t w = 0; w < workers_.size(); w++) {
+        workers_[w].join();
+    }
+    workers_.clear();
+    for (size_t i = 0; i < streams_.size(); i++) {
+        streams_[i]->reader.join();
+    }
+}
+
+// Reader thread of one stream. A live source (a camera, or a file paced like
+// one) hands over with drop-oldest, as the capture thread of vidDisplay does;
+// an unpaced file waits for room instead, so every frame is filtered and the
+// stream runs as fast as its share of the workers allows.
+void StreamServer::readLoop(Stream *s) {
+    long long index = 0;
+    double start = now();
+    while (running_) {
+        Frame f;
+        s->freeCaptured.tryPop(f.image);
+        if (!s->capture.read(f.image) || f.image.empty()) {
+            if (s->config.loop && s->capture.set(cv::CAP_PROP_POS_FRAMES, 0) && s->capture.read(f.image) &&
+                !f.image.empty()) {
+                // the clip starts over, the pacing with it
+                start = now() - index / s->sourceFps;
+            } else {
+                break;
+            }
+        }
+        f.index = index++;
+        f.timestamp = now();
+
+        if (!s->live) {
+            bool queued = false;
+            while (running_ && !(queued = s->captured.tryPush(f))) {
+                idle();
+            }
+            s->read += queued;
+            continue;
+        }
+        s->read++;
+        Frame evicted;
+        if (s->captured.pushDropOldest(f, evicted)) {
+            s->dropped++;
+            if (!evicted.image.empty()) {
+                s->freeCaptured.tryPush(evicted.image);
+            }
+        }
+
+        if (s->config.pace) {
+            double wait = start + index / s->sourceFps - now();
+            if (wait > 0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            }
+        }
+    }
+    s->ended = true;
+}
+
+// Claims the stream, filters its oldest waiting frame and releases it.
+// Returns false if another worker holds the stream or nothing is waiting.
+bool StreamServer::runOnce(Stream &s) {
+    bool expected = false;
+    if (!s.busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        return false;
+    }
+    Frame f;
+    if (!s.captured.tryPop(f)) {
+        s.busy.store(false, std::memory_order_release);
+        return false;
+    }
+
+    s.context.frameIndex = f.index;
+    s.context.timestamp = f.timestamp;
+    cv::Mat result;
+    if (s.pipeline.process(f.image, result, s.context) != 0) {
+        s.failed++;
+    } else {
+        s.latency.record((now() - f.timestamp) * 1000.0);
+        s.frames++;
+        if (keepLatest_) {
+            std::lock_guard<std::mutex> guard(s.outLock);
+            result.copyTo(s.latest);
+        }
+    }
+    // result may share the pipeline's buffer or the captured frame, so it
+    // goes before the frame is handed back to the reader
+    result.release();
+    s.freeCaptured.tryPush(f.image);
+    s.busy.store(false, std::memory_order_release);
+    return true;
+}
+
+// worker thread: the cursor hands out the streams in turn, so every stream
+// with a waiting frame is served once before any stream is served twice
+void StreamServer::workLoop() {
+    const size_t n = streams_.size();
+    while (running_) {
+        bool worked = false;
+        for (size_t tries = 0; tries < n && !worked; tries++) {
+            worked = runOnce(*streams_[next_++ % n]);
+        }
+        if (!worked) {
+            idle();
+        }
+    }
+}
+
+// every frame the reader delivered has been filtered, failed or dropped
+bool StreamServer::drained(const Stream &s) {
+    return s.ended && s.frames + s.failed + s.dropped == s.read;
+}
+
+bool StreamServer::finished() const {
+    for (size_t i = 0; i < streams_.size(); i++) {
+        if (!drained(*streams_[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<StreamStats> StreamServer::stats() {
+    double t = now();
+    double seconds = t - lastReport_;
+    lastReport_ = t;
+
+    std::vector<StreamStats> all;
+    for (size_t i = 0; i < streams_.size(); i++) {
+        Stream &s = *streams_[i];
+        StreamStats st;
+        st.id = s.id;
+        st.source = s.config.source;
+        st.frames = s.frames;
+        st.dropped = s.dropped;
+        st.failed = s.failed;
+        st.fps = seconds > 0 ? (st.frames - s.reportedFrames) / seconds : 0.0;
+        s.reportedFrames = st.frames;
+        st.latencyP50Ms = s.latency.percentileMs(0.50);
+        st.latencyP95Ms = s.latency.percentileMs(0.95);
+        st.latencyMaxMs = s.latency.maxMs();
+        st.ended = drained(s);
+        all.push_back(st);
+    }
+    return all;
+}
+
+bool StreamServer::latest(int id, cv::Mat &frame) const {
+    if (id < 0 || id >= (int)streams_.size()) {
+        return false;
+    }
+    const Stream &s = *streams_[id];
+    std::lock_guard<std::mutex> guard(s.outLock);
+    if (s.latest.empty()) {
+        return false;
+    }
+    s.latest.copyTo(frame);
+    return true;
+}
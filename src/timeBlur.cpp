@@ -15,9 +15,7 @@
 #include "opencv2/opencv.hpp" // include the OpenCV image processing library headers
 #include "filter.h"
 
-// prototypes for the functions to test
-int blur5x5_1( cv::Mat &src, cv::Mat &dst );
-int blur5x5_2( cv::Mat &src, cv::Mat &dst );
+// the functions to test are declared in filter.h
 
 // returns a double which gives time in seconds
 double getTime() {
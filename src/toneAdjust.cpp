@@ -0,0 +1,69 @@
+/**
+ * @file toneAdjust.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief brightness / contrast adjustment through a single 256-entry table
+ * @version 0.1
+ * @date 2024-02-27
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include "toneAdjust.h"
+#include "lut.h"
+
+ToneAdjust::ToneAdjust()
+    : brightness_(0.0f), contrast_(1.0f), stretch_(false), identity_(true), lut_(identityLut().clone()) {
+}
+
+bool ToneAdjust::set(float brightness, float contrast) {
+    if (brightness == brightness_ && contrast == contrast_) {
+        return false;
+    }
+    brightness_ = brightness;
+    contrast_ = contrast;
+
+    // run the original per-frame steps once over the 256 possible values,
+    // so every rounding and saturation matches them exactly
+    cv::Mat t = identityLut().clone();
+    t.convertTo(t, -1, contrast, brightness);
+    t += cv::Scalar(brightness, brightness, brightness);
+    t *= contrast;
+    lut_ = t;
+
+    // e.g. +10 then -10 brightness lands back on the identity
+    identity_ = memcmp(lut_.ptr<uchar>(0), identityLut().ptr<uchar>(0), 256) == 0;
+    return true;
+}
+
+int ToneAdjust::apply(cv::Mat &src, cv::Mat &dst) {
+    if (src.empty() || src.depth() != CV_8U) {
+        return -1;
+    }
+    if (!stretch_) {
+        if (identity_) {
+            if (dst.data != src.data) {
+                src.copyTo(dst);
+            }
+            return 0;
+        }
+        return applyLut(src, dst, lut_);
+    }
+
+    // The table is monotonic, so the adjusted frame's range is the table at
+    // the raw frame's min and max; the stretch is folded into the same lookup.
+    double rawMin, rawMax;
+    cv::minMaxLoc(src.reshape(1), &rawMin, &rawMax);
+    const uchar *t = lut_.ptr<uchar>(0);
+    double lo = std::min(t[(int)rawMin], t[(int)rawMax]);
+    double hi = std::max(t[(int)rawMin], t[(int)rawMax]);
+
+    // the scale and shift cv::normalize(NORM_MINMAX, 0, 255) would use
+    double scale = 255.0 * (hi - lo > DBL_EPSILON ? 1.0 / (hi - lo) : 0.0);
+    double shift = -lo * scale;
+    cv::Mat stretchLut;
+    affineLut(scale, shift, stretchLut);
+    composeLut(lut_, stretchLut, frameLut_);
+    return applyLut(src, dst, frameLut_);
+}
@@ -7,42 +7,304 @@
 */
 
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include "filter.h"
-#include "faceDetect.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "toneAdjust.h"
+#include "frameQueue.h"
+#include "framePool.h"
+#include "profiler.h"
+#include "recorder.h"
 
+// Settings chosen with the keyboard on the display thread and picked up by
+// the processing thread; version changes whenever anything is updated.
+struct Controls {
+    std::mutex lock;
+    std::string spec;
+    float brightness = 0.0f; // Range can be -100 to 100
+    float contrast = 1.0f;   // Range can be 0.5 to 3.0
+    std::atomic<int> version{0};
+};
+
+// State shared by the capture, processing, display and recording threads.
+// Frames go capture -> process -> display (and -> record); buffers that have
+// been consumed go back through the free queues to be filled again.
+struct Session {
+    cv::VideoCapture *capdev = NULL;
+    std::atomic<bool> running{true};
+    bool stretch = false; // stretch every frame to 0..255 after brightness / contrast
+    // sizes of the shown and the recorded frames; empty = the processed size
+    cv::Size previewSize, recordSize;
+
+    Controls controls;
+
+    BoundedQueue<Frame> captured{2};
+    BoundedQueue<Frame> processed{2};
+    BoundedQueue<cv::Mat> freeCaptured{8};
+    BoundedQueue<cv::Mat> freeProcessed{8};
+
+    // encodes on its own thread; started and stopped with the 'r' key
+    AsyncRecorder recorder;
+
+    std::atomic<long long> droppedCaptured{0}, droppedDisplay{0};
+};
+
+// how long an idle thread waits before looking at its queue again
+static void idle() {
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+}
+
+static double now() {
+    return cv::getTickCount() / cv::getTickFrequency();
+}
+
+// hand a buffer back to its free queue; if that is full the buffer is released
+static void recycle(BoundedQueue<cv::Mat> &pool, cv::Mat &image) {
+    if (!image.empty()) {
+        pool.tryPush(image);
+    }
+    image.release();
+}
+
+// capture thread: read frames into recycled buffers as fast as the camera delivers
+static void captureLoop(Session *s) {
+    long long index = 0;
+    while (s->running) {
+        Frame f;
+        s->freeCaptured.tryPop(f.image);
+
+        // reading into a buffer of the right size does not reallocate
+        {
+            PROFILE_SCOPE("capture");
+            *s->capdev >> f.image;
+        }
+        if (f.image.empty()) {
+            printf("frame is empty\n");
+            s->running = false;
+            break;
+        }
+        f.index = index++;
+        f.timestamp = now();
+
+        // when processing falls behind the oldest frame is dropped, so the
+        // frame being filtered is never more than a couple of frames old
+        Frame evicted;
+        if (s->captured.pushDropOldest(f, evicted)) {
+            s->droppedCaptured++;
+            recycle(s->freeCaptured, evicted.image);
+        }
+    }
+}
+
+// copy src into dst, resized to size unless that is empty or already src's size
+static void copyScaled(const cv::Mat &src, cv::Mat &dst, cv::Size size) {
+    if (size.area() == 0 || size == src.size()) {
+        src.copyTo(dst);
+    } else {
+        cv::resize(src, dst, size, 0, 0, size.area() < src.size().area() ? cv::INTER_AREA : cv::INTER_LINEAR);
+    }
+}
+
+// processing thread: brightness / contrast, then the filter pipeline
+static void processLoop(Session *s) {
+    FilterPipeline pipeline;
+    ToneAdjust tone;
+    tone.setStretch(s->stretch);
+    FrameContext context;
+    cv::Mat processedFrame;
+    std::string specError;
+    int version = -1;
+
+    while (s->running) {
+        Frame f;
+        if (!s->captured.tryPop(f)) {
+            idle();
+            continue;
+        }
+
+        // pick up new settings from the keyboard
+        if (version != s->controls.version) {
+            std::lock_guard<std::mutex> guard(s->controls.lock);
+            version = s->controls.version;
+            // the tone table is only rebuilt when brightness or contrast changed
+            tone.set(s->controls.brightness, s->controls.contrast);
+            // the chain is only rebuilt when the mode changes
+            if (s->controls.spec != pipeline.spec() && !pipeline.parse(s->controls.spec, &specError)) {
+                printf("Bad filter chain: %s\n", specError.c_str());
+            }
+        }
+
+        cv::Mat &frame = f.image;
+        context.frameIndex = f.index;
+        context.timestamp = f.timestamp;
+
+        // Apply brightness and contrast adjustment, one table lookup per byte
+        if (!tone.identity()) {
+            PROFILE_SCOPE("tone");
+            tone.apply(frame, frame);
+        }
+
+        {
+            PROFILE_SCOPE("filter chain");
+            if (pipeline.process(frame, processedFrame, context) != 0) {
+                processedFrame = frame;
+            }
+        }
+
+        // the pipeline reuses its buffers, so the result is copied (or
+        // scaled to the preview size) into a recycled frame the display thread can keep
+        Frame out;
+        out.index = f.index;
+        out.timestamp = f.timestamp;
+        s->freeProcessed.tryPop(out.image);
+        copyScaled(processedFrame, out.image, s->previewSize);
+
+        // the recorder copies the frame as it is after the chain, so the
+        // file gets its real size and channel count
+        if (s->recorder.recording()) {
+            s->recorder.push(processedFrame, f.index, f.timestamp, s->recordSize);
+        }
+
+        processedFrame.release();
+        recycle(s->freeCaptured, frame);
+
+        Frame evicted;
+        if (s->processed.pushDropOldest(out, evicted)) {
+            s->droppedDisplay++;
+            recycle(s->freeProcessed, evicted.image);
+        }
+    }
+}
+
+// file name suffix made of the stage names of a spec, e.g. "_sepia_blur"
+static std::string specSuffix(const std::string &spec) {
+    std::string suffix;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find('|', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        std::string stage = spec.substr(start, end - start);
+        stage = stage.substr(0, stage.find(':'));
+        if (!stage.empty()) {
+            suffix += "_" + stage;
+        }
+        start = end + 1;
+    }
+    return suffix;
+}
+
+// "1280x720" -> size; false if it is not WxH with both positive
+static bool parseSize(const char *text, cv::Size &size) {
+    int w = 0, h = 0;
+    if (sscanf(text, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+        return false;
+    }
+    size = cv::Size(w, h);
+    return true;
+}
+
+// print what a finished recording wrote; returns the frames it dropped
+static long long reportRecording(const RecorderStats &stats) {
+    if (stats.fourcc.empty()) {
+        printf("Nothing recorded to %s\n", stats.path.c_str());
+    } else {
+        printf("Recorded %lld frames to %s (%s, %dx%d, %d channel%s, %.1f fps), %lld dropped\n",
+               stats.written, stats.path.c_str(), stats.fourcc.c_str(), stats.size.width, stats.size.height,
+               stats.channels, stats.channels == 1 ? "" : "s", stats.fps, stats.dropped);
+    }
+    return stats.dropped;
+}
+
+// stage spec of an expensive key mode, with the proxy options appended
+static std::string proxied(const std::string &stage, int factor, bool guided) {
+    if (factor <= 1) {
+        return stage;
+    }
+    std::string options = "proxy=" + std::to_string(factor) + (guided ? ",guided=1" : "");
+    return stage + (stage.find(':') == std::string::npos ? ":" : ",") + options;
+}
 
 int main(int argc, char *argv[]) {
-    cv::VideoCapture *capdev;
+    // every Mat the threads create reuses a pooled buffer once warmed up
+    installFramePool();
+    Session session;
+
+    // filter chain used when no mode key is active, e.g. -p "sepia|blur|cartoon:levels=15"
+    std::string baseSpec;
+    // stage timings are written here every few seconds, e.g. -P timings.csv
+    std::string profilePath;
+    // sepia, emboss and cartoon keys run at 1/proxy size, e.g. -x 2 (-g: guided upsampling)
+    int proxy = 1;
+    bool guided = false;
+    // codec of the 'r' recordings, e.g. -c h264 (mjpg, h264 or ffv1)
+    RecordCodec codec = RECORD_MJPG;
+
+    // optional thread count for the filters, e.g. "-t 8" (default: all cores)
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0) {
+            session.stretch = true;
+        } else if (strcmp(argv[i], "-g") == 0) {
+            guided = true;
+        } else if (i + 1 == argc) {
+            break;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            setFilterThreads(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-p") == 0) {
+            baseSpec = argv[++i];
+        } else if (strcmp(argv[i], "-P") == 0) {
+            profilePath = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0) {
+            if (!parseRecordCodec(argv[++i], codec)) {
+                printf("Bad codec %s, expected mjpg, h264 or ffv1\n", argv[i]);
+                return(-1);
+            }
+        } else if (strcmp(argv[i], "-x") == 0) {
+            proxy = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-D") == 0 || strcmp(argv[i], "-R") == 0) {
+            // -D preview size, -R recording size, e.g. -D 960x540 -R 1920x1080
+            cv::Size &size = argv[i][1] == 'D' ? session.previewSize : session.recordSize;
+            if (!parseSize(argv[++i], size)) {
+                printf("Bad size %s, expected WxH\n", argv[i]);
+                return(-1);
+            }
+        }
+    }
+
+    FilterPipeline check;
+    std::string specError;
+    if (!check.parse(baseSpec, &specError)) {
+        printf("Bad filter chain: %s\n", specError.c_str());
+        return(-1);
+    }
+    session.controls.spec = baseSpec;
 
     // open the video device
-    capdev = new cv::VideoCapture(0);
-    if( !capdev->isOpened() ) {
+    session.capdev = new cv::VideoCapture(0);
+    if( !session.capdev->isOpened() ) {
         printf("Unable to open video device\n");
         return(-1);
     }
 
-    cv::Size refS( (int) capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
-                   (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
+    cv::Size refS( (int) session.capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
+                   (int) session.capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
     printf("Expected size: %d %d\n", refS.width, refS.height);
 
     cv::namedWindow("Video", 1);
 
-    // Create the variables for the processed frames
-    cv::Mat frame, processedFrame, grayFrame;
-    cv::Mat sobelXOutput, sobelYOutput, magnitudeOutput;
-    cv::Mat quantizedOutput;
-
-    cv::Mat grey;
-    std::vector<cv::Rect> faces;
-    cv:: Rect last(0, 0, 0, 0);
-
-    cv::VideoWriter videoWriter;
-
-    
     // modes flags
-    bool grayMode = false, altGrayMode = false, sepiaMode = false, blurMode = false; 
+    bool grayMode = false, altGrayMode = false, sepiaMode = false, blurMode = false;
     bool sobelXMode = false, sobelYMode = false, magnitudeMode = false;
     bool quantizeMode = false;
     bool faceDetectionMode = false;
@@ -52,22 +314,62 @@ int main(int argc, char *argv[]) {
     bool horizontalWarpMode = false;
     bool verticalWarpMode = false;
 
-
-    bool isRecording = false;
-
     float brightness = 0.0f; // Range can be -100 to 100
     float contrast = 1.0f;   // Range can be 0.5 to 3.0
+    std::string spec = baseSpec;
 
-    // main loop
-    for(;;) {
-        *capdev >> frame;
-        if( frame.empty() ) {
-            printf("frame is empty\n");
-            break;
+    // stage timers run while the overlay is shown or timings are being written
+    bool overlayMode = false;
+    setProfiling(!profilePath.empty());
+    double lastDump = now(), fpsStart = now(), fps = 0.0;
+    int fpsFrames = 0;
+    cv::Mat overlayFrame;
+    int recordCount = 0;
+    long long droppedRecord = 0;
+
+    std::thread captureThread(captureLoop, &session);
+    std::thread processThread(processLoop, &session);
+
+    // the display thread is the main thread, as highgui requires
+    cv::Mat shown;
+    while (session.running) {
+        Frame f;
+        if (session.processed.tryPop(f)) {
+            if (profilingEnabled()) {
+                static StageHistogram &latency = profileStage("latency");
+                latency.record((now() - f.timestamp) * 1000.0);
+            }
+            if (++fpsFrames == 10) {
+                double t = now();
+                fps = fpsFrames / (t - fpsStart);
+                fpsStart = t;
+                fpsFrames = 0;
+            }
+
+            PROFILE_SCOPE("imshow");
+            if (overlayMode) {
+                // drawn on a copy, so 's' still saves the clean frame
+                f.image.copyTo(overlayFrame);
+                drawProfileOverlay(overlayFrame, fps);
+                cv::imshow("Video", overlayFrame);
+            } else {
+                cv::imshow("Video", f.image);
+            }
+            // keep the last frame for 's', give the previous one back
+            recycle(session.freeProcessed, shown);
+            shown = f.image;
+        }
+
+        if (!profilePath.empty() && now() - lastDump > 5.0) {
+            writeProfile(profilePath);
+            lastDump = now();
         }
 
         // Check for a keystroke
-        char key = cv::waitKey(10);
+        char key = cv::waitKey(1);
+        if (key == -1) {
+            continue;
+        }
 
         if( key == 'q') {
             break;
@@ -82,12 +384,12 @@ int main(int argc, char *argv[]) {
         }
         if (key == 'p'){
             sepiaMode = !sepiaMode; // Toggle sepiaTone mode
-            grayMode = false;       // Turn off standard grayscale mode 
+            grayMode = false;       // Turn off standard grayscale mode
             altGrayMode = false;    // Turn off alternative grayscale mode
         }
         if (key == 'b'){
             blurMode = !blurMode; // Toggle blur mode
-            grayMode = false;     // Turn off standard grayscale mode 
+            grayMode = false;     // Turn off standard grayscale mode
             altGrayMode = false;  // Turn off alternative grayscale mode
             sepiaMode = false;    // Turn off sepiaTone mode
         }
@@ -116,13 +418,7 @@ int main(int argc, char *argv[]) {
         }
         if (key == 'c') {
             colorfulFacesMode = !colorfulFacesMode;
-            if (colorfulFacesMode) {
-            // Convert frame to grey and detect faces
-            cv::Mat greyFrame;
-            cv::cvtColor(frame, greyFrame, cv::COLOR_BGR2GRAY);
-            detectFaces(greyFrame, faces);
-            }
-        } 
+        }
         if (key == 'u') {
             brightness += 10.0f;
         }
@@ -146,143 +442,72 @@ int main(int argc, char *argv[]) {
             verticalWarpMode = !verticalWarpMode;
             if (verticalWarpMode) horizontalWarpMode = false; // Disable horizontal warp when vertical warp is enabled
         }
+        if (key == 'k') {
+            // frame rate and stage times on screen
+            overlayMode = !overlayMode;
+            setProfiling(overlayMode || !profilePath.empty());
+        }
         if (key == 'r') {
-            if (!isRecording) {
-                // Start recording
-                std::string filename = "recorded_video.avi";  // Name of the output video file
-                int codec = cv::VideoWriter::fourcc('M', 'J', 'P', 'G'); // Define the codec
-                double frameRate = 20.0; // Set frame rate
-                videoWriter.open(filename, codec, frameRate, cv::Size(refS.width, refS.height));
-
-                if (!videoWriter.isOpened()) {
-                    std::cerr << "Could not open the video file for write\n";
-                    return -1;
-                }
+            // the file opens on the recorder's thread once the first frames tell
+            // it the size and frame rate; stopping writes what is still queued
+            if (session.recorder.recording()) {
+                droppedRecord += reportRecording(session.recorder.stop());
             } else {
-                // Stop recording
-                videoWriter.release();
+                std::string filename = "recorded_video_" + std::to_string(recordCount++) + "." + recordExtension(codec);
+                session.recorder.start(filename, codec);
             }
-            isRecording = !isRecording;
         }
 
-
-        // Apply brightness and contrast adjustment
-        frame.convertTo(frame, -1, contrast, brightness);
-        frame += cv::Scalar(brightness, brightness, brightness);
-        frame *= contrast;
-        cv::normalize(frame, frame, 0, 255, cv::NORM_MINMAX);
-        frame.convertTo(frame, CV_8UC3);
-
-        // Process the frame based on the filter's mode
+        // Pick the filter chain for the active mode; the order of the checks is
+        // the priority between modes that are switched on at the same time
+        spec = baseSpec;
         if(grayMode) {
-            cv::cvtColor(frame, processedFrame, cv::COLOR_BGR2GRAY);
+            spec = "gray";
         } else if(altGrayMode) {
-            greyscale(frame, processedFrame); // Apply custom grayscale
+            spec = "altgray";
         } else if(sepiaMode) {
-            sepiaTone(frame, processedFrame); // Apply sepiaTone
+            spec = proxied("sepia", proxy, guided);
         } else if (blurMode){
-            blur5x5_2(frame, processedFrame); // Apply blur gaussian 5x5_2
+            spec = "blur";
         } else if (sobelXMode) {
-            sobelX3x3(frame, sobelXOutput);
-            cv::convertScaleAbs(sobelXOutput, processedFrame);
+            spec = "sobelX";
         } else if (sobelYMode) {
-            sobelY3x3(frame, sobelYOutput);
-            cv::convertScaleAbs(sobelYOutput, processedFrame);
+            spec = "sobelY";
         } else if (magnitudeMode) {
-            sobelX3x3(frame, sobelXOutput);
-            sobelY3x3(frame, sobelYOutput);
-            magnitude(sobelXOutput, sobelYOutput, magnitudeOutput);
-            cv::convertScaleAbs(magnitudeOutput, processedFrame);
+            spec = "magnitude";
         } else if (quantizeMode) {
-            int levels = 10; // Default number of levels
-            blurQuantize(frame, quantizedOutput, levels);
-            processedFrame = quantizedOutput;
+            spec = "quantize:levels=10";
         } else if (faceDetectionMode) {
-            cv::Mat resizedFrame;
-            float scale = 0.5; // Reduce the frame size to 50% to avoid lag
-            cv::resize(frame, resizedFrame, cv::Size(), scale, scale);
-
-            cv::cvtColor(resizedFrame, grey, cv::COLOR_BGR2GRAY);
-            detectFaces(grey, faces);
-
-            // Scale the face rectangles and draw them on the original frame
-            for (cv::Rect &face : faces) {
-                face.x /= scale;
-                face.y /= scale;
-                face.width /= scale;
-                face.height /= scale;
-                cv::rectangle(frame, face, cv::Scalar(0, 255, 0), 2);
-            }
-
-            processedFrame = frame;
+            spec = "face:scale=0.5,async=1"; // Reduce the frame size to 50% to avoid lag
         } else if (negativeMode){
-            negativeFilter(frame, processedFrame); // Apply negative filter
+            spec = "negative";
         } else if (colorfulFacesMode){
-            colorfulFaces(frame, faces, processedFrame); // Apply colorful faces
+            spec = "colorfulFaces:detect=1"; // faces follow the video
         } else if(embossMode){
-            embossEffect(frame, processedFrame); // Apply emboss effect
+            spec = proxied("emboss", proxy, guided);
         } else if (cartoonMode) {
-            int levels = 15; // Adjust as needed
-            int magThreshold = 20; // Adjust as needed
-            cartoon(frame, processedFrame, levels, magThreshold);
+            spec = proxied("cartoon:levels=15,threshold=20", proxy, guided);
         } else if (horizontalWarpMode) {
-            warpImage(frame, processedFrame, true); // Apply horizontal warp
+            spec = "warp:dir=h";
         } else if (verticalWarpMode) {
-            warpImage(frame, processedFrame, false); // Apply vertical warp
-        } else {
-            processedFrame = frame.clone();
-        }
-        if (isRecording) {
-            videoWriter.write(processedFrame);
+            spec = "warp:dir=v";
         }
 
-        cv::imshow("Video", processedFrame);
+        {
+            std::lock_guard<std::mutex> guard(session.controls.lock);
+            session.controls.spec = spec;
+            session.controls.brightness = brightness;
+            session.controls.contrast = contrast;
+            session.controls.version++;
+        }
 
         // Save the processed frame if 's' is pressed
-        if(key == 's') {
+        if(key == 's' && !shown.empty()) {
             static int imageCount = 0;
-            std::string filename = "capture_" + std::to_string(imageCount++);
-            if(grayMode) {
-                filename += "_gray.jpg";
-            } 
-            else if(altGrayMode){
-                filename += "_altgray.jpg";
-            } 
-            else if(sepiaMode){
-                filename += "_sepia.jpg";
-            }
-            else if(blurMode){
-                filename += "_blur.jpg";
-            }
-            else if(sobelXMode){
-                filename += "_sobelX.jpg";
-            }
-            else if(sobelYMode){
-                filename += "_sobelY.jpg";
-            }
-            else if (magnitudeMode){
-                filename += "_magnitude.jpg";
-            } 
-            else if (quantizeMode){
-                filename += "_quantize.jpg";
-            } 
-            else if (faceDetectionMode) {
-                filename += "_face.jpg";
-            } 
-            else if (embossMode) {
-                filename += "_emboss.jpg";
-            }
-            else if (negativeMode) {
-                filename += "_negative.jpg";
-            }
-            else if (colorfulFacesMode) {
-                filename += "_colorfulFaces.jpg";
-            }
-            else {
-                filename += ".jpg";
-        }
+            // name the file after the stages of the chain, e.g. capture_0_sepia_blur.jpg
+            std::string filename = "capture_" + std::to_string(imageCount++) + specSuffix(spec) + ".jpg";
 
-        if(cv::imwrite(filename, processedFrame)) {
+            if(cv::imwrite(filename, shown)) {
                 std::cout << "Saved " << filename << std::endl;
             } else {
                 std::cout << "Failed to save image" << std::endl;
@@ -290,7 +515,20 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    videoWriter.release();
-    delete capdev;
+    session.running = false;
+    captureThread.join();
+    processThread.join();
+    if (session.recorder.recording()) {
+        droppedRecord += reportRecording(session.recorder.stop());
+    }
+
+    printf("Dropped frames: %lld before processing, %lld before display, %lld before recording\n",
+           (long long)session.droppedCaptured, (long long)session.droppedDisplay, droppedRecord);
+    printPoolStats(framePool()->stats());
+    if (!profilePath.empty()) {
+        writeProfile(profilePath);
+    }
+
+    delete session.capdev;
     return(0);
 }
@@ -0,0 +1,179 @@
+/**
+ * @file warp.cpp
+ * @author Yuan Zhao zhao.yuan2@northeatern.edu
+ * @brief sine-wave warp with a cached displacement table
+ * @version 0.1
+ * @date 2024-02-28
+*/
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "warp.h"
+#include "parallel.h"
+
+// the table of the columns (horizontal) or rows (vertical) of an image of
+// `size` whose rows are `step` bytes apart
+void WarpEngine::build(cv::Size size, size_t step, const WarpParams &params) {
+    const int length = params.horizontal ? size.width : size.height;
+    if (length != length_ || params.frequency != frequency_) {
+        sin_.resize(length);
+        cos_.resize(length);
+        for (int i = 0; i < length; i++) {
+            sin_[i] = sin(2 * M_PI * i / params.frequency);
+            cos_[i] = cos(2 * M_PI * i / params.frequency);
+        }
+        frequency_ = params.frequency;
+    }
+    length_ = length;
+    size_ = size;
+    step_ = step;
+    params_ = params;
+    shift_.resize(length);
+    weight_.assign(length, 0);
+
+    // sin(t + phase) = sin t cos phase + cos t sin phase
+    const double a = params.amplitude * cos(params.phase), b = params.amplitude * sin(params.phase);
+    for (int i = 0; i < length; i++) {
+        double d = a * sin_[i] + b * cos_[i];
+        if (params.sampling == WARP_NEAREST) {
+            // truncated, as the original per-pixel code did
+            shift_[i] = static_cast<int>(d);
+        } else {
+            int base = cvFloor(d);
+            int w = cvRound((d - base) * 256);
+            if (w == 256) {
+                base++;
+                w = 0;
+            }
+            shift_[i] = base;
+            weight_[i] = w;
+        }
+    }
+
+    // horizontal: rows that every column reads inside the image (and, for
+    // bilinear, with a row below) take no bounds checks
+    offset_.clear();
+    rowBegin_ = rowEnd_ = 0;
+    if (!params.horizontal) {
+        return;
+    }
+    offset_.resize(length);
+    int begin = 0, end = size.height;
+    for (int i = 0; i < length; i++) {
+        offset_[i] = (ptrdiff_t)shift_[i] * (ptrdiff_t)step + i * 3;
+        begin = std::max(begin, -shift_[i]);
+        end = std::min(end, size.height - shift_[i] - (params.sampling == WARP_BILINEAR ? 1 : 0));
+    }
+    rowBegin_ = begin;
+    rowEnd_ = std::max(begin, end);
+}
+
+// blend of two pixels, w = weight of b in 1/256
+static inline uchar lerp8(int a, int b, int w) {
+    return static_cast<uchar>((a * (256 - w) + b * w + 128) >> 8);
+}
+
+int WarpEngine::apply(cv::Mat &src, cv::Mat &dst, const WarpParams &params) {
+    if (src.empty() || src.type() != CV_8UC3 || params.frequency == 0) {
+        return -1;
+    }
+    // every output pixel reads another pixel, so an in-place call needs a copy
+    cv::Mat in = src.data == dst.data ? src.clone() : src;
+    dst.create(in.size(), in.type());
+
+    const int rows = in.rows, cols = in.cols, cn = 3;
+    const size_t step = in.step[0];
+    if (in.size() != size_ || step != step_ || params.horizontal != params_.horizontal
+        || params.amplitude != params_.amplitude || params.frequency != params_.frequency
+        || params.phase != params_.phase || params.sampling != params_.sampling) {
+        build(in.size(), step, params);
+    }
+    const int *shift = shift_.data();
+    const int *weight = weight_.data();
+    const ptrdiff_t *offset = offset_.data();
+    const bool bilinear = params.sampling == WARP_BILINEAR;
+
+    parallelRows(0, rows, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            uchar *d = dst.ptr<uchar>(y);
+
+            if (params.horizontal) {
+                // each column reads its own source row. Rows that no column
+                // reads past the image are a plain gather through the offset
+                // table; the rest check every column and fill black.
+                if (y >= rowBegin_ && y < rowEnd_) {
+                    const uchar *s = in.ptr<uchar>(y);
+                    if (!bilinear) {
+                        for (int x = 0; x < cols; x++) {
+                            const uchar *a = s + offset[x];
+                            d[3 * x] = a[0];
+                            d[3 * x + 1] = a[1];
+                            d[3 * x + 2] = a[2];
+                        }
+                        continue;
+                    }
+                    const uchar *t = s + step;
+                    for (int x = 0; x < cols; x++) {
+                        const uchar *a = s + offset[x], *b = t + offset[x];
+                        int w = weight[x];
+                        d[3 * x] = lerp8(a[0], b[0], w);
+                        d[3 * x + 1] = lerp8(a[1], b[1], w);
+                        d[3 * x + 2] = lerp8(a[2], b[2], w);
+                    }
+                    continue;
+                }
+                for (int x = 0; x < cols; x++) {
+                    int sy = y + shift[x];
+                    uchar *p = d + x * cn;
+                    if (sy < 0 || sy >= rows) {
+                        p[0] = p[1] = p[2] = 0;
+                        continue;
+                    }
+                    const uchar *a = in.ptr<uchar>(sy) + x * cn;
+                    if (!bilinear || weight[x] == 0) {
+                        p[0] = a[0];
+                        p[1] = a[1];
+                        p[2] = a[2];
+                    } else {
+                        const uchar *b = in.ptr<uchar>(std::min(sy + 1, rows - 1)) + x * cn;
+                        p[0] = lerp8(a[0], b[0], weight[x]);
+                        p[1] = lerp8(a[1], b[1], weight[x]);
+                        p[2] = lerp8(a[2], b[2], weight[x]);
+                    }
+                }
+                continue;
+            }
+
+            // vertical: the whole row moves by one amount, so it is a shifted
+            // copy with black where the source row ends
+            const uchar *s = in.ptr<uchar>(y);
+            int dx = shift[y];
+            int xStart = std::min(cols, std::max(0, -dx));
+            int xEnd = std::max(xStart, std::min(cols, cols - dx));
+            memset(d, 0, (size_t)xStart * cn);
+            memset(d + xEnd * cn, 0, (size_t)(cols - xEnd) * cn);
+            if (xEnd == xStart) {
+                continue;
+            }
+
+            const uchar *a = s + (xStart + dx) * cn;
+            int w = weight[y];
+            if (!bilinear || w == 0) {
+                memcpy(d + xStart * cn, a, (size_t)(xEnd - xStart) * cn);
+                continue;
+            }
+            // the last source pixel has no right neighbour and is copied
+            int n = (xEnd - xStart - (xEnd + dx == cols ? 1 : 0)) * cn;
+            uchar *p = d + xStart * cn;
+            for (int i = 0; i < n; i++) {
+                p[i] = lerp8(a[i], a[i + cn], w);
+            }
+            for (int i = n; i < (xEnd - xStart) * cn; i++) {
+                p[i] = a[i];
+            }
+        }
+    });
+    return 0;
+}